@@ -0,0 +1,132 @@
+//for sched_setaffinity and syscall
+#define _GNU_SOURCE
+
+#include "affinity.h"
+
+#ifdef __linux__
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+/**
+ * pins each thread of a team of omp_get_max_threads() threads to a core of its own, from the
+ * cores the process may run on - the same threads are kept for later parallel regions of that
+ * size, so must be called before the lattice is allocated for its pages to be first touched
+ * where they will be used
+ * returns whether every thread could be pinned
+ */
+bool bind_threads(binding b)
+{
+#ifdef __linux__
+    if (b == BIND_NONE)
+    {
+        return true;
+    }
+
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(cpu_set_t), &allowed) != 0)
+    {
+        return false;
+    }
+
+    //cores the process may run on, in order
+    int cores[CPU_SETSIZE];
+    int n_cores = 0;
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+    {
+        if (CPU_ISSET(cpu, &allowed))
+        {
+            cores[n_cores++] = cpu;
+        }
+    }
+
+    bool bound = true;
+    #pragma omp parallel reduction(&&:bound)
+    {
+        int t = omp_get_thread_num();
+        int threads = omp_get_num_threads();
+
+        //more threads than cores share them round robin either way
+        int k = b == BIND_CLOSE || threads >= n_cores ? t % n_cores : (int) ((long) t * n_cores / threads);
+
+        cpu_set_t one;
+        CPU_ZERO(&one);
+        CPU_SET(cores[k], &one);
+        bound = sched_setaffinity(0, sizeof(cpu_set_t), &one) == 0;
+    }
+    return bound;
+#else
+    return b == BIND_NONE;
+#endif
+}
+
+/**
+ * the NUMA node of the core the calling thread is running on, or -1 if not known
+ */
+int cpu_node(void)
+{
+#ifdef __linux__
+    unsigned cpu, node;
+    if (syscall(SYS_getcpu, &cpu, &node, NULL) == 0)
+    {
+        return (int) node;
+    }
+#endif
+    return -1;
+}
+
+/**
+ * the NUMA node holding most of the pages of a box of the lattice, or -1 if not known - looks
+ * up the page at the start of each row of the box, and at the end if it is on another page
+ */
+int box_node(lattice l, box b)
+{
+#ifdef __linux__
+    long page = sysconf(_SC_PAGESIZE);
+    int rows = BOX_HEIGHT(b);
+
+    void **pages = malloc(2 * rows * sizeof(void *));
+    int *status = malloc(2 * rows * sizeof(int));
+    if (pages == NULL || status == NULL)
+    {
+        printf("failed to alloc\n");
+        exit(EXIT_FAILURE);
+    }
+
+    int n_pages = 0;
+    for (int i = b.il; i <= b.iu; ++i)
+    {
+        uintptr_t first = (uintptr_t) get_site(l, i, b.jl) / page * page;
+        uintptr_t last = (uintptr_t) get_site(l, i, b.ju) / page * page;
+        pages[n_pages++] = (void *) first;
+        if (last != first)
+        {
+            pages[n_pages++] = (void *) last;
+        }
+    }
+
+    //with no nodes to move to, move_pages only reports the node of each page
+    int node = -1;
+    if (syscall(SYS_move_pages, 0, (unsigned long) n_pages, pages, NULL, status, 0) == 0)
+    {
+        //most common node among the pages, where nodes are small numbers
+        int votes[64] = {0};
+        for (int k = 0; k < n_pages; ++k)
+        {
+            if (status[k] >= 0 && status[k] < 64 && ++votes[status[k]] > (node >= 0 ? votes[node] : 0))
+            {
+                node = status[k];
+            }
+        }
+    }
+
+    free(pages);
+    free(status);
+    return node;
+#else
+    (void) l;
+    (void) b;
+    return -1;
+#endif
+}
@@ -0,0 +1,22 @@
+#ifndef __AFFINITY_H
+#define __AFFINITY_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <omp.h>
+#include "lattice.h"
+
+//how the threads of the team are pinned to cores, as for OMP_PROC_BIND
+typedef enum
+{
+    BIND_NONE, //left to the OS to move around
+    BIND_CLOSE, //thread k on the k-th core the process may run on
+    BIND_SPREAD //threads spaced out evenly over those cores, so over every socket
+} binding;
+
+bool bind_threads(binding b);
+int cpu_node(void);
+int box_node(lattice l, box b);
+
+#endif
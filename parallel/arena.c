@@ -0,0 +1,78 @@
+#include "arena.h"
+
+/**
+ * initialises an empty arena - blocks are only allocated once needed
+ */
+void arena_init(arena *a)
+{
+    a->first = NULL;
+    a->current = NULL;
+    a->used = 0;
+}
+
+/**
+ * hands out `size' zeroed bytes, which stay valid until the arena is reset or freed
+ */
+void *arena_alloc(arena *a, size_t size)
+{
+    size = (size + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN;
+
+    if (a->current == NULL || a->used + size > a->current->size)
+    {
+        //move on to the next block kept from before a reset, or a new one if that is too small
+        block *next = a->current != NULL ? a->current->next : a->first;
+        if (next == NULL || next->size < size)
+        {
+            size_t block_size = MAX(size, ARENA_BLOCK);
+            block *b = malloc(sizeof(block) + block_size);
+            if (b == NULL)
+            {
+                printf("failed to alloc\n");
+                exit(EXIT_FAILURE);
+            }
+            b->size = block_size;
+            b->next = next;
+
+            if (a->current != NULL)
+            {
+                a->current->next = b;
+            }
+            else
+            {
+                a->first = b;
+            }
+            next = b;
+        }
+
+        a->current = next;
+        a->used = 0;
+    }
+
+    void *p = a->current->data + a->used;
+    a->used += size;
+    memset(p, 0, size);
+    return p;
+}
+
+/**
+ * releases everything handed out by the arena at once - its blocks are kept to reuse
+ */
+void arena_reset(arena *a)
+{
+    a->current = NULL;
+    a->used = 0;
+}
+
+/**
+ * cleans up memory held by an arena
+ */
+void arena_free(arena *a)
+{
+    while (a->first != NULL)
+    {
+        block *next = a->first->next;
+        free(a->first);
+        a->first = next;
+    }
+    arena_init(a);
+}
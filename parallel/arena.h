@@ -0,0 +1,36 @@
+#ifndef __ARENA_H
+#define __ARENA_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "util.h"
+
+//smallest block an arena takes from malloc at once
+#define ARENA_BLOCK (1 << 20)
+
+//every allocation is rounded up to keep the next one aligned
+#define ARENA_ALIGN 16
+
+//a chunk of memory allocations are carved from
+typedef struct _block
+{
+    struct _block *next;
+    size_t size; //bytes of data
+    unsigned char data[];
+} block;
+
+//bump allocator handing out memory from large blocks, which is all released at once
+typedef struct
+{
+    block *first; //blocks in the order they are used
+    block *current; //block allocations are coming from, NULL if none yet
+    size_t used; //bytes handed out from the current block
+} arena;
+
+void arena_init(arena *a);
+void *arena_alloc(arena *a, size_t size);
+void arena_reset(arena *a);
+void arena_free(arena *a);
+
+#endif
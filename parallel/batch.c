@@ -0,0 +1,257 @@
+#include "batch.h"
+
+/**
+ * adds a value to a running mean and variance
+ */
+void stats_add(stats *s, double x)
+{
+    ++s->count;
+    double delta = x - s->mean;
+    s->mean += delta / s->count;
+    s->m2 += delta * (x - s->mean);
+}
+
+/**
+ * combines the running mean and variance of another series of values into a (Chan et al.)
+ */
+void stats_merge(stats *a, stats b)
+{
+    if (b.count == 0) return;
+
+    long count = a->count + b.count;
+    double delta = b.mean - a->mean;
+    a->mean += delta * b.count / count;
+    a->m2 += b.m2 + delta * delta * a->count * b.count / count;
+    a->count = count;
+}
+
+/**
+ * unbiased sample variance of the values seen so far
+ */
+double stats_variance(stats s)
+{
+    return s.count > 1 ? s.m2 / (s.count - 1) : 0;
+}
+
+/**
+ * half the width of a 95% confidence interval for the mean, from the normal approximation
+ */
+double stats_halfwidth(stats s)
+{
+    return s.count > 0 ? 1.96 * sqrt(stats_variance(s) / s.count) : 0;
+}
+
+/**
+ * reads configurations from a file, one per line as `lattice_size seed_prob seed_what percolation_kind',
+ * skipping blank lines and lines starting with #
+ * returns the number read, and stores them in a newly allocated array
+ */
+int read_configs(FILE *f, config **configs)
+{
+    int n_configs = 0;
+    int max = 16;
+    *configs = malloc(max * sizeof(config));
+    if (*configs == NULL)
+    {
+        printf("failed to alloc\n");
+        exit(EXIT_FAILURE);
+    }
+
+    char line[256];
+    for (int number = 1; fgets(line, sizeof(line), f) != NULL; ++number)
+    {
+        char first;
+        if (sscanf(line, " %c", &first) != 1 || first == '#')
+        {
+            continue;
+        }
+
+        config c;
+        char seed_type[2];
+        if (sscanf(line, "%d %lf %1s %d", &c.n, &c.p, seed_type, &c.kind) != 4
+            || c.n <= 1 || c.p < 0 || c.p > 1 || c.kind < 0 || c.kind > 2
+            || (seed_type[0] != 's' && seed_type[0] != 'b'))
+        {
+            printf("invalid config on line %d: %s", number, line);
+            exit(EXIT_FAILURE);
+        }
+        c.bonds = seed_type[0] == 'b';
+
+        //each configuration's trials are drawn from their own counters, which have room for 2^24
+        if (n_configs == 1 << 24)
+        {
+            printf("too many configs, at most %d\n", 1 << 24);
+            exit(EXIT_FAILURE);
+        }
+
+        if (n_configs == max)
+        {
+            max *= 2;
+            *configs = realloc(*configs, max * sizeof(config));
+            if (*configs == NULL)
+            {
+                printf("failed to alloc\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        (*configs)[n_configs++] = c;
+    }
+
+    return n_configs;
+}
+
+/**
+ * returns a lattice of size n held in the given buffer, which is only reallocated if too small
+ */
+lattice reuse_lattice(lattice *buffer, int n)
+{
+    if (buffer->n < n)
+    {
+        delete_lattice(*buffer);
+        *buffer = create_lattice(n);
+    }
+
+    lattice l = {buffer->sites, n};
+    return l;
+}
+
+/**
+ * prints the statistics of one configuration, as a csv line or the next object of a json array
+ */
+void print_config(config c, int index, stats perc, stats size, double time, format f)
+{
+    double perc_error = stats_halfwidth(perc);
+    double size_error = stats_halfwidth(size);
+
+    if (f == FORMAT_JSON)
+    {
+        printf("%s{\"n\": %d, \"p\": %.6f, \"seed_what\": \"%c\", \"percolation_kind\": %d, \"trials\": %ld, ",
+            index > 0 ? ",\n" : "", c.n, c.p, c.bonds ? 'b' : 's', c.kind, perc.count);
+        printf("\"percolation_probability\": %.6f, \"percolation_variance\": %.6f, \"percolation_ci\": [%.6f, %.6f], ",
+            perc.mean, stats_variance(perc), MAX(perc.mean - perc_error, 0), MIN(perc.mean + perc_error, 1));
+        printf("\"mean_max_cluster\": %.2f, \"max_cluster_variance\": %.2f, \"max_cluster_ci\": [%.2f, %.2f], \"time\": %.4f}",
+            size.mean, stats_variance(size), size.mean - size_error, size.mean + size_error, time);
+    }
+    else
+    {
+        printf("%d,%.6f,%c,%d,%ld,%.6f,%.6f,%.6f,%.6f,%.2f,%.2f,%.2f,%.2f,%.4f\n",
+            c.n, c.p, c.bonds ? 'b' : 's', c.kind, perc.count,
+            perc.mean, stats_variance(perc), MAX(perc.mean - perc_error, 0), MIN(perc.mean + perc_error, 1),
+            size.mean, stats_variance(size), size.mean - size_error, size.mean + size_error, time);
+    }
+
+    //results come out as each configuration finishes, not all at the end
+    fflush(stdout);
+}
+
+/**
+ * runs `trials' random lattices of each configuration and prints the mean, variance and 95% confidence
+ * interval of whether they percolate and of their max cluster size
+ *
+ * lattices, stacks and visited arrays are allocated once and reused by every trial - small lattices have
+ * whole trials spread over the threads, larger ones use all threads for each trial in turn
+ * every trial is drawn under the one seed, trial k of configuration c from counters of its own (see TRIAL),
+ * whichever thread runs it - so batches with different seeds never share lattices
+ */
+void run_batch(config *configs, int n_configs, int trials, options o, uint64_t seed, format f)
+{
+    int num_threads = omp_get_max_threads();
+
+    lattice *buffers = calloc(num_threads, sizeof(lattice));
+    workspace *spaces = malloc(num_threads * sizeof(workspace));
+
+    //per-thread running stats, combined in thread order once each configuration is done
+    stats *perc = malloc(num_threads * sizeof(stats));
+    stats *size = malloc(num_threads * sizeof(stats));
+
+    if (buffers == NULL || spaces == NULL || perc == NULL || size == NULL)
+    {
+        printf("failed to alloc\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int t = 0; t < num_threads; ++t)
+    {
+        workspace_init(&spaces[t]);
+    }
+
+    if (f == FORMAT_JSON)
+    {
+        printf("[\n");
+    }
+    else
+    {
+        printf("n,p,seed_what,percolation_kind,trials,percolation_probability,percolation_variance,");
+        printf("percolation_ci_low,percolation_ci_high,mean_max_cluster,max_cluster_variance,");
+        printf("max_cluster_ci_low,max_cluster_ci_high,time\n");
+    }
+
+    for (int c = 0; c < n_configs; ++c)
+    {
+        config cfg = configs[c];
+        bool rows = cfg.kind == 0 || cfg.kind == 2;
+        bool cols = cfg.kind == 1 || cfg.kind == 2;
+
+        memset(perc, 0, num_threads * sizeof(stats));
+        memset(size, 0, num_threads * sizeof(stats));
+
+        double start = omp_get_wtime();
+
+        //static schedule so the same trials are combined in the same order on every run
+        #pragma omp parallel num_threads(cfg.n <= BATCH_SMALL_LATTICE ? num_threads : 1)
+        {
+            int t = omp_get_thread_num();
+
+            //a trial on its own thread labels its lattice as a single box rather than starting more
+            //threads - the thread count set here only applies to regions started from this thread
+            if (cfg.n <= BATCH_SMALL_LATTICE)
+            {
+                omp_set_num_threads(1);
+            }
+
+            #pragma omp for schedule(static)
+            for (int k = 0; k < trials; ++k)
+            {
+                lattice l = reuse_lattice(&buffers[t], cfg.n);
+
+                if (cfg.bonds)
+                {
+                    seed_bonds(l, cfg.p, seed, TRIAL(c, k));
+                }
+                else
+                {
+                    seed_sites(l, cfg.p, seed, TRIAL(c, k));
+                }
+
+                int64_t max_cluster;
+                bool percolates = percolation(l, rows, cols, o, &max_cluster, NULL, &spaces[t]);
+
+                stats_add(&perc[t], percolates);
+                stats_add(&size[t], max_cluster);
+            }
+        }
+
+        for (int t = 1; t < num_threads; ++t)
+        {
+            stats_merge(&perc[0], perc[t]);
+            stats_merge(&size[0], size[t]);
+        }
+
+        print_config(cfg, c, perc[0], size[0], omp_get_wtime() - start, f);
+    }
+
+    if (f == FORMAT_JSON)
+    {
+        printf("\n]\n");
+    }
+
+    for (int t = 0; t < num_threads; ++t)
+    {
+        delete_lattice(buffers[t]);
+        workspace_free(&spaces[t]);
+    }
+    free(buffers);
+    free(spaces);
+    free(perc);
+    free(size);
+}
@@ -0,0 +1,44 @@
+#ifndef __BATCH_H
+#define __BATCH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "lattice.h"
+#include "percolation.h"
+
+//lattices up to this size have whole trials run on separate threads, larger ones are split into boxes
+#define BATCH_SMALL_LATTICE 1024
+
+//how the results of a batch are printed
+typedef enum
+{
+    FORMAT_CSV, //a header, then one line per configuration
+    FORMAT_JSON //an array with one object per configuration
+} format;
+
+//a lattice to run repeated trials of
+typedef struct
+{
+    int n; //lattice size
+    double p; //seeding probability
+    bool bonds; //whether bonds (rather than sites) are seeded
+    int kind; //0/1/2 for row/col/both percolation checking
+} config;
+
+//running mean and variance of a series of values, updated one value at a time (Welford)
+typedef struct
+{
+    long count;
+    double mean;
+    double m2; //sum of squared differences from the mean
+} stats;
+
+void stats_add(stats *s, double x);
+void stats_merge(stats *a, stats b);
+double stats_variance(stats s);
+double stats_halfwidth(stats s);
+int read_configs(FILE *f, config **configs);
+void run_batch(config *configs, int n_configs, int trials, options o, uint64_t seed, format f);
+
+#endif
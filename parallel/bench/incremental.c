@@ -0,0 +1,95 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <omp.h>
+#include "lattice.h"
+#include "percolation.h"
+#include "incremental.h"
+#include "rng.h"
+
+/**
+ * microbenchmark of incremental updates against solving the whole lattice again: perturbs a
+ * lattice seeded at the threshold by closing random occupied sites (or bonds) and opening
+ * them again, asking whether it still percolates after each change
+ * usage: bench/incremental [lattice_size] [changes] [num_threads]
+ */
+int main(int argc, char *argv[])
+{
+    int n = argc > 1 ? atoi(argv[1]) : 2000;
+    int changes = argc > 2 ? atoi(argv[2]) : 100000;
+    omp_set_num_threads(argc > 3 ? atoi(argv[3]) : omp_get_num_procs());
+
+    printf("n=%d, changes=%d, threads=%d\n", n, changes, omp_get_max_threads());
+    printf("model,solve_time,init_time,change_time,speedup,percolating\n");
+
+    for (int bonds = 0; bonds <= 1; ++bonds)
+    {
+        double p = bonds ? 0.5 : 0.592746;
+        lattice l = create_lattice(n);
+        if (bonds)
+        {
+            seed_bonds(l, p, 1, 0);
+        }
+        else
+        {
+            seed_sites(l, p, 1, 0);
+        }
+
+        //one full solve, as each query would need without incremental updates
+        options o = {ENGINE_UF, MERGE_TREE, 0, 0, NULL};
+        int64_t max_cluster;
+        double start = omp_get_wtime();
+        percolation(l, true, true, o, &max_cluster, NULL, NULL);
+        double solve_time = omp_get_wtime() - start;
+
+        start = omp_get_wtime();
+        incremental s;
+        incremental_init(&s, l);
+        double init_time = omp_get_wtime() - start;
+
+        //random sites to perturb, drawn up front so only the changes are timed
+        coord *at = malloc(changes * sizeof(coord));
+        if (at == NULL)
+        {
+            printf("failed to alloc\n");
+            exit(EXIT_FAILURE);
+        }
+        for (int k = 0; k < changes; ++k)
+        {
+            uint32_t ctr[4] = {(uint32_t) k, 0, STREAM_ORDER, 0};
+            uint32_t r[4];
+            philox(2, ctr, r);
+            at[k].i = r[0] % n;
+            at[k].j = r[1] % n;
+        }
+
+        int percolating = 0;
+        start = omp_get_wtime();
+        for (int k = 0; k < changes; ++k)
+        {
+            //close a site (or the E bond of one) and ask, then put it back and ask again
+            if (bonds && bond(l, at[k], EAST))
+            {
+                incremental_close_bond(&s, at[k], EAST);
+                percolating += incremental_percolates(&s, true, true);
+                incremental_open_bond(&s, at[k], EAST);
+            }
+            else if (!bonds && (*get_site(l, at[k].i, at[k].j) & OCCUPIED))
+            {
+                incremental_close_site(&s, at[k]);
+                percolating += incremental_percolates(&s, true, true);
+                incremental_open_site(&s, at[k]);
+            }
+            percolating += incremental_percolates(&s, true, true);
+        }
+        double change_time = (omp_get_wtime() - start) / changes;
+
+        printf("%s,%.4fs,%.4fs,%.2fus,%.0fx,%d\n", bonds ? "bonds" : "sites", solve_time, init_time,
+            change_time * 1e6, solve_time / change_time, percolating);
+
+        free(at);
+        incremental_free(&s);
+        delete_lattice(l);
+    }
+
+    return EXIT_SUCCESS;
+}
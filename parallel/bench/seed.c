@@ -0,0 +1,69 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+#include "lattice.h"
+#include "rng.h"
+
+#define REPEATS 5
+
+/**
+ * best wall time over REPEATS runs of seeding a lattice of sites or bonds
+ */
+double time_seeding(lattice l, bool bonds, double p)
+{
+    double best = 0;
+    for (int k = 0; k < REPEATS; ++k)
+    {
+        double start = omp_get_wtime();
+        if (bonds)
+        {
+            seed_bonds(l, p, k + 1, 0);
+        }
+        else
+        {
+            seed_sites(l, p, k + 1, 0);
+        }
+        double time = omp_get_wtime() - start;
+        best = k == 0 ? time : MIN(best, time);
+    }
+    return best;
+}
+
+/**
+ * microbenchmark of lattice seeding with the SIMD kernels turned off and on
+ * usage: bench/seed [lattice_size] [num_threads]
+ */
+int main(int argc, char *argv[])
+{
+    int n = argc > 1 ? atoi(argv[1]) : 10000;
+    omp_set_num_threads(argc > 2 ? atoi(argv[2]) : omp_get_num_procs());
+
+    lattice scalar = create_lattice(n);
+    lattice simd = create_lattice(n);
+
+    printf("n=%d, threads=%d, avx2=%s\n", n, omp_get_max_threads(), use_avx2() ? "yes" : "no");
+    printf("model,scalar_time,simd_time,speedup,identical\n");
+
+    for (int bonds = 0; bonds <= 1; ++bonds)
+    {
+        double p = bonds ? 0.5 : 0.592746;
+
+        simd_enabled = false;
+        double scalar_time = time_seeding(scalar, bonds, p);
+
+        simd_enabled = true;
+        double simd_time = time_seeding(simd, bonds, p);
+
+        //both were last seeded with the same seed, so must match exactly
+        bool identical = memcmp(scalar.sites, simd.sites, (size_t) n * n) == 0;
+
+        printf("%s,%.4fs,%.4fs,%.2fx,%s\n", bonds ? "bonds" : "sites", scalar_time, simd_time,
+            scalar_time / simd_time, identical ? "yes" : "no");
+    }
+
+    delete_lattice(scalar);
+    delete_lattice(simd);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,341 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+#include "lattice.h"
+#include "percolation.h"
+#include "batch.h"
+
+//most values in each comma separated list
+#define MAX_LIST 64
+
+//phases of a run which are timed separately
+#define N_PHASES 7
+const char *phase_names[N_PHASES] = {"alloc", "seed_sites", "seed_bonds", "label", "merge", "reduce", "solve"};
+
+//fractions of the way through the sorted times which are reported
+#define N_QUANTILES 7
+const double quantiles[N_QUANTILES] = {0, 0.1, 0.25, 0.5, 0.75, 0.9, 1};
+const char *quantile_names[N_QUANTILES] = {"min", "p10", "p25", "median", "p75", "p90", "max"};
+
+/**
+ * usage message for wrong args
+ */
+void exit_incorrect_args()
+{
+    printf("usage: bench/suite [options]\n");
+    printf("options:\n");
+    printf("\t--n sizes\tcomma separated lattice sizes (default: 1000,2000,4000)\n");
+    printf("\t--p probs\tcomma separated seeding probabilities (default: 0.592746)\n");
+    printf("\t--threads counts\tcomma separated thread counts (default: 1 up to the number of cores, doubling)\n");
+    printf("\t--model s/b\tlattice solved is site or bond seeded (default: s)\n");
+    printf("\t--weak\tgrow each size by sqrt(threads), so the sites per thread stay the same\n");
+    printf("\t--warmup runs\tuntimed runs before each configuration (default: 1)\n");
+    printf("\t--reps runs\ttimed runs of each configuration (default: 10)\n");
+    printf("\t--format csv/json\toutput format (default: csv)\n");
+    printf("\t--engine dfs/uf/lp, --merge tree/serial/concurrent, --tile rowsxcols\tas for ./main\n");
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * reads a comma separated list of numbers, returning how many there were
+ */
+int parse_list(char *s, double *values)
+{
+    int count = 0;
+    for (char *t = strtok(s, ","); t != NULL; t = strtok(NULL, ","))
+    {
+        if (count == MAX_LIST)
+        {
+            exit_incorrect_args();
+        }
+        values[count++] = atof(t);
+    }
+    return count;
+}
+
+/**
+ * compares two times for qsort
+ */
+int compare_times(const void *a, const void *b)
+{
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * the q-th quantile of sorted times, interpolating between the nearest two
+ */
+double quantile(const double *sorted, int count, double q)
+{
+    double x = q * (count - 1);
+    int k = (int) x;
+    if (k + 1 >= count)
+    {
+        return sorted[count - 1];
+    }
+    return sorted[k] + (x - k) * (sorted[k + 1] - sorted[k]);
+}
+
+/**
+ * prints the spread of the times of one phase of one configuration
+ */
+void print_phase(int n, double p, char model, int threads, int phase, double *times, int reps, format f, bool first)
+{
+    qsort(times, reps, sizeof(double), compare_times);
+
+    if (f == FORMAT_JSON)
+    {
+        printf("%s{\"n\": %d, \"p\": %.6f, \"model\": \"%c\", \"threads\": %d, \"phase\": \"%s\", \"reps\": %d",
+            first ? "" : ",\n", n, p, model, threads, phase_names[phase], reps);
+        for (int q = 0; q < N_QUANTILES; ++q)
+        {
+            printf(", \"%s\": %.6f", quantile_names[q], quantile(times, reps, quantiles[q]));
+        }
+        printf("}");
+    }
+    else
+    {
+        printf("%d,%.6f,%c,%d,%s,%d", n, p, model, threads, phase_names[phase], reps);
+        for (int q = 0; q < N_QUANTILES; ++q)
+        {
+            printf(",%.6f", quantile(times, reps, quantiles[q]));
+        }
+        printf("\n");
+    }
+    fflush(stdout);
+}
+
+/**
+ * runs every phase once on a new n by n lattice, storing how long each took
+ */
+void run_once(int n, double p, bool bonds, options o, uint64_t seed, workspace *w, double *times)
+{
+    double start = omp_get_wtime();
+    lattice l = create_lattice(n);
+    times[0] = omp_get_wtime() - start;
+
+    //the lattice solved is the one seeded last
+    for (int k = 0; k < 2; ++k)
+    {
+        bool seed_bonds_now = k == 0 ? !bonds : bonds;
+
+        start = omp_get_wtime();
+        if (seed_bonds_now)
+        {
+            seed_bonds(l, p, seed, 0);
+        }
+        else
+        {
+            seed_sites(l, p, seed, 0);
+        }
+        times[seed_bonds_now ? 2 : 1] = omp_get_wtime() - start;
+    }
+
+    int64_t max_cluster;
+    timings t;
+    t.detail = NULL;
+    start = omp_get_wtime();
+    percolation(l, true, true, o, &max_cluster, &t, w);
+    times[6] = omp_get_wtime() - start;
+    times[3] = t.label;
+    times[4] = t.merge;
+    times[5] = t.reduce;
+
+    delete_lattice(l);
+}
+
+/**
+ * benchmark driver - times each phase of the solver separately over a sweep of lattice sizes,
+ * probabilities and thread counts, and prints the spread of the times as csv or json
+ */
+int main(int argc, char *argv[])
+{
+    double ns[MAX_LIST] = {1000, 2000, 4000};
+    double ps[MAX_LIST] = {0.592746};
+    double thread_counts[MAX_LIST];
+    int n_ns = 3, n_ps = 1, n_threads = 0;
+
+    options o = {ENGINE_DFS, MERGE_TREE, 0, 0};
+    bool bonds = false;
+    bool weak = false;
+    int warmup = 1;
+    int reps = 10;
+    format f = FORMAT_CSV;
+
+    for (int k = 1; k < argc; ++k)
+    {
+        char *name = argv[k];
+
+        if (strcmp(name, "--weak") == 0)
+        {
+            weak = true;
+            continue;
+        }
+
+        if (strncmp(name, "--", 2) != 0 || k + 1 == argc)
+        {
+            exit_incorrect_args();
+        }
+        name += 2;
+        char *value = argv[++k];
+
+        if (strcmp(name, "n") == 0)
+        {
+            n_ns = parse_list(value, ns);
+        }
+        else if (strcmp(name, "p") == 0)
+        {
+            n_ps = parse_list(value, ps);
+        }
+        else if (strcmp(name, "threads") == 0)
+        {
+            n_threads = parse_list(value, thread_counts);
+        }
+        else if (strcmp(name, "model") == 0 && (strcmp(value, "s") == 0 || strcmp(value, "b") == 0))
+        {
+            bonds = value[0] == 'b';
+        }
+        else if (strcmp(name, "warmup") == 0)
+        {
+            warmup = atoi(value);
+        }
+        else if (strcmp(name, "reps") == 0)
+        {
+            reps = atoi(value);
+        }
+        else if (strcmp(name, "format") == 0 && strcmp(value, "csv") == 0)
+        {
+            f = FORMAT_CSV;
+        }
+        else if (strcmp(name, "format") == 0 && strcmp(value, "json") == 0)
+        {
+            f = FORMAT_JSON;
+        }
+        else if (strcmp(name, "engine") == 0 && strcmp(value, "dfs") == 0)
+        {
+            o.engine = ENGINE_DFS;
+        }
+        else if (strcmp(name, "engine") == 0 && strcmp(value, "uf") == 0)
+        {
+            o.engine = ENGINE_UF;
+        }
+        else if (strcmp(name, "engine") == 0 && strcmp(value, "lp") == 0)
+        {
+            o.engine = ENGINE_LP;
+        }
+        else if (strcmp(name, "merge") == 0 && strcmp(value, "tree") == 0)
+        {
+            o.merge = MERGE_TREE;
+        }
+        else if (strcmp(name, "merge") == 0 && strcmp(value, "serial") == 0)
+        {
+            o.merge = MERGE_SERIAL;
+        }
+        else if (strcmp(name, "merge") == 0 && strcmp(value, "concurrent") == 0)
+        {
+            o.merge = MERGE_CONCURRENT;
+        }
+        else if (strcmp(name, "tile") == 0)
+        {
+            if (sscanf(value, "%dx%d", &o.tile_rows, &o.tile_cols) != 2 || o.tile_rows < 1 || o.tile_cols < 1)
+            {
+                exit_incorrect_args();
+            }
+        }
+        else
+        {
+            exit_incorrect_args();
+        }
+    }
+
+    //by default 1, 2, 4, ... threads, up to the number of cores
+    if (n_threads == 0)
+    {
+        for (int t = 1; t < omp_get_num_procs(); t *= 2)
+        {
+            thread_counts[n_threads++] = t;
+        }
+        thread_counts[n_threads++] = omp_get_num_procs();
+    }
+
+    if (reps < 1 || warmup < 0)
+    {
+        exit_incorrect_args();
+    }
+
+    double *times = malloc((size_t) N_PHASES * reps * sizeof(double));
+    if (times == NULL)
+    {
+        printf("failed to alloc\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (f == FORMAT_JSON)
+    {
+        printf("[\n");
+    }
+    else
+    {
+        printf("n,p,model,threads,phase,reps");
+        for (int q = 0; q < N_QUANTILES; ++q)
+        {
+            printf(",%s", quantile_names[q]);
+        }
+        printf("\n");
+    }
+
+    bool first = true;
+    for (int a = 0; a < n_ns; ++a)
+    {
+        for (int b = 0; b < n_ps; ++b)
+        {
+            for (int c = 0; c < n_threads; ++c)
+            {
+                int threads = (int) thread_counts[c];
+                int n = weak ? (int) (ns[a] * sqrt(threads)) : (int) ns[a];
+                double p = ps[b];
+
+                if (n < 2 || p < 0 || p > 1 || threads < 1)
+                {
+                    exit_incorrect_args();
+                }
+
+                omp_set_num_threads(threads);
+
+                //buffers are kept across runs, as in a batch
+                workspace w;
+                workspace_init(&w);
+
+                //run k gives the k-th time of each phase, stored phase by phase
+                double run[N_PHASES];
+                for (int k = -warmup; k < reps; ++k)
+                {
+                    run_once(n, p, bonds, o, k + warmup + 1, &w, run);
+                    for (int phase = 0; k >= 0 && phase < N_PHASES; ++phase)
+                    {
+                        times[phase * reps + k] = run[phase];
+                    }
+                }
+
+                workspace_free(&w);
+
+                for (int phase = 0; phase < N_PHASES; ++phase)
+                {
+                    print_phase(n, p, bonds ? 'b' : 's', threads, phase, times + phase * reps, reps, f, first);
+                    first = false;
+                }
+            }
+        }
+    }
+
+    if (f == FORMAT_JSON)
+    {
+        printf("\n]\n");
+    }
+
+    free(times);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,504 @@
+#include "cubic.h"
+
+/**
+ * returns a new empty simple cubic lattice of size n by n by n
+ */
+cubic create_cubic(int n)
+{
+    cubic l;
+    l.n = n;
+    l.sites = calloc((size_t) n * n * n, sizeof(site));
+    if (l.sites == NULL)
+    {
+        printf("failed to alloc\n");
+        exit(EXIT_FAILURE);
+    }
+
+    return l;
+}
+
+/**
+ * returns a pointer to the site identified by (x, y, z) in the lattice
+ */
+site *get_cubic_site(cubic l, int x, int y, int z)
+{
+    return l.sites + ((size_t) z * l.n + y) * l.n + x;
+}
+
+/**
+ * frees up memory used by the given lattice
+ */
+void delete_cubic(cubic l)
+{
+    free(l.sites);
+}
+
+/**
+ * forms the D bonds of a row of occupied sites, given the same row of the layer below
+ */
+void down_bonds_row(site *row, const site *below, int n)
+{
+    for (int j = 0; j < n; ++j)
+    {
+        row[j] |= (row[j] & below[j] & OCCUPIED) << 3;
+    }
+}
+
+/**
+ * which of three rounds layer z of a cubic lattice has its bonds or sites filled in - even layers,
+ * odd layers, then the first layer if n is odd, so that a layer is never read by the layers next to
+ * it in the same round as it is written
+ */
+int layer_round(int z, int n)
+{
+    return z == 0 && n % 2 == 1 ? 2 : z % 2;
+}
+
+/**
+ * seeds the sites of a cubic lattice with probability p, and forms bonds appropriately
+ *
+ * row y of layer z is drawn as row z * n + y of a square lattice, so only depends on `seed`
+ */
+void seed_cubic_sites(cubic l, double p, uint64_t seed)
+{
+    int n = l.n;
+
+    #pragma omp parallel
+    {
+        uint32_t *r = malloc(n * sizeof(uint32_t));
+        if (r == NULL)
+        {
+            printf("failed to alloc\n");
+            exit(EXIT_FAILURE);
+        }
+
+        #pragma omp for
+        for (int k = 0; k < n * n; ++k)
+        {
+            sites_row(get_cubic_site(l, 0, k % n, k / n), k, n, p, seed, 0, r);
+        }
+        free(r);
+    }
+
+    //each layer is done by one thread, a row at a time, as its rows read the next row in the layer
+    for (int round = 0; round < 3; ++round)
+    {
+        #pragma omp parallel for schedule(static)
+        for (int z = 0; z < n; ++z)
+        {
+            if (layer_round(z, n) != round)
+            {
+                continue;
+            }
+
+            for (int y = 0; y < n; ++y)
+            {
+                site *row = get_cubic_site(l, 0, y, z);
+                site_bonds_row(row, get_cubic_site(l, 0, WRAP(y + 1, n), z), n);
+                down_bonds_row(row, get_cubic_site(l, 0, y, WRAP(z + 1, n)), n);
+            }
+        }
+    }
+}
+
+/**
+ * seeds the bonds of a cubic lattice with probability p, and fills the sites appropriately
+ */
+void seed_cubic_bonds(cubic l, double p, uint64_t seed)
+{
+    int n = l.n;
+    uint64_t threshold = rng_threshold(p);
+
+    #pragma omp parallel
+    {
+        uint32_t *r = malloc(n * sizeof(uint32_t));
+        if (r == NULL)
+        {
+            printf("failed to alloc\n");
+            exit(EXIT_FAILURE);
+        }
+
+        #pragma omp for
+        for (int k = 0; k < n * n; ++k)
+        {
+            site *row = get_cubic_site(l, 0, k % n, k / n);
+            bonds_row(row, k, n, p, seed, 0, r);
+            rng_row(seed, 0, STREAM_BONDS_DOWN, k, n, r);
+            mask_row(row, r, n, threshold, BOND_DOWN);
+        }
+        free(r);
+    }
+
+    //as for a square lattice, then the bonds from the layer above and to the one below - in rounds
+    //of layers, as for the sites
+    for (int round = 0; round < 3; ++round)
+    {
+        #pragma omp parallel for schedule(static)
+        for (int z = 0; z < n; ++z)
+        {
+            if (layer_round(z, n) != round)
+            {
+                continue;
+            }
+
+            for (int y = 0; y < n; ++y)
+            {
+                site *row = get_cubic_site(l, 0, y, z);
+                site *up = get_cubic_site(l, 0, y, WRAP(z - 1, n));
+
+                bond_sites_row(row, get_cubic_site(l, 0, WRAP(y - 1, n), z), n);
+                for (int j = 0; j < n; ++j)
+                {
+                    row[j] |= (row[j] | up[j]) & BOND_DOWN ? OCCUPIED : 0;
+                }
+            }
+        }
+    }
+}
+
+/**
+ * initialises an empty set of labels for an n by n by n lattice, which also keep the layers each reaches
+ */
+void cubic_labels_init(labels *u, int n, int max)
+{
+    labels_init(u, n, max);
+    labels_layered(u);
+}
+
+/**
+ * the run of an axis reached by the cluster with canonical label a
+ */
+span cubic_reach(labels *u, int a, int axis)
+{
+    return axis == AXIS_X ? u->cols[a] : axis == AXIS_Y ? u->rows[a] : u->layers[a];
+}
+
+/**
+ * hands out a new label for a cluster holding the single site c
+ */
+int cubic_labels_new(labels *u, coord3 c)
+{
+    coord layer = {c.y, c.x};
+    int a = labels_new(u, layer);
+    u->layers[a] = span_point(c.z);
+    return a;
+}
+
+/**
+ * adds the site c to the cluster with label a, where c is bonded to a site of that cluster
+ * returns the canonical label of the cluster
+ */
+int cubic_labels_add(labels *u, int a, coord3 c)
+{
+    coord layer = {c.y, c.x};
+    a = labels_add(u, a, layer);
+    u->layers[a] = span_join(u->layers[a], span_point(c.z), c.z, u->n);
+    return a;
+}
+
+/**
+ * specifies that the clusters with labels a and b are the same, where the site c belongs
+ * to a and is bonded to a site belonging to b
+ * returns the canonical label of the merged cluster
+ */
+int cubic_labels_union(labels *u, int a, int b, coord3 c)
+{
+    a = labels_find(u, a);
+    b = labels_find(u, b);
+
+    if (a == b) return a;
+
+    coord layer = {c.y, c.x};
+    span layers = span_join(u->layers[a], u->layers[b], c.z, u->n);
+    a = labels_union(u, a, b, layer);
+    u->layers[a] = layers;
+    return a;
+}
+
+/**
+ * counts a finished cluster towards the max and spanning of a slab
+ */
+void finish_cluster(slab *s, labels *u, int a)
+{
+    s->max = MAX(s->max, u->size[a]);
+    for (int axis = 0; axis < N_AXES; ++axis)
+    {
+        s->spans[axis] |= cubic_reach(u, a, axis).len == u->n;
+    }
+}
+
+/**
+ * moves the clusters still reachable from the given layers of labels into a fresh set of labels,
+ * relabelling the layers to match - every other cluster is complete, so is counted towards the
+ * slab and dropped
+ * remap is scratch space with a zeroed entry for each label in u
+ */
+void compact_cubic_labels(labels *u, labels *v, int *remap, int **layers, int n_layers, size_t area, slab *s)
+{
+    v->count = 1;
+
+    for (int k = 0; k < n_layers; ++k)
+    {
+        int *label = layers[k];
+        for (size_t j = 0; j < area; ++j)
+        {
+            if (label[j])
+            {
+                int a = labels_find(u, label[j]);
+                if (remap[a] == 0)
+                {
+                    remap[a] = labels_copy(v, u, a);
+                }
+                label[j] = remap[a];
+            }
+        }
+    }
+
+    for (int a = 1; a < u->count; ++a)
+    {
+        if (u->parent[a] == a && remap[a] == 0)
+        {
+            finish_cluster(s, u, a);
+        }
+        remap[a] = 0;
+    }
+}
+
+/**
+ * labels the clusters of the layers zl to zu of a slab one layer at a time (Hoshen-Kopelman), keeping
+ * only the labels of the layer above and the first layer, so memory is O(n^2) rather than the whole slab
+ *
+ * bonds within each layer wrap around - bonds out of the slab are left for stitching slabs together,
+ * so clusters which reach the first or last layer are kept in s->u along with the labels of both layers
+ */
+void label_slab(cubic l, slab *s)
+{
+    int n = l.n;
+    size_t area = (size_t) n * n;
+
+    //labels of the sites in the layer above and this layer
+    int *above = calloc(area, sizeof(int));
+    int *current = calloc(area, sizeof(int));
+    s->first = calloc(area, sizeof(int));
+
+    labels u, v;
+    cubic_labels_init(&u, n, 2 * n);
+    cubic_labels_init(&v, n, 2 * n);
+    int remap_size = u.max;
+    int *remap = calloc(remap_size, sizeof(int));
+
+    if (above == NULL || current == NULL || s->first == NULL || remap == NULL)
+    {
+        printf("failed to alloc\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int z = s->zl; z <= s->zu; ++z)
+    {
+        site *layer = get_cubic_site(l, 0, 0, z);
+        site *up = z > s->zl ? get_cubic_site(l, 0, 0, z - 1) : NULL;
+
+        for (int y = 0; y < n; ++y)
+        {
+            for (int x = 0; x < n; ++x)
+            {
+                size_t k = (size_t) y * n + x;
+                coord3 c = {x, y, z};
+
+                if (!(layer[k] & OCCUPIED))
+                {
+                    current[k] = 0;
+                    continue;
+                }
+
+                //labels of the neighbours already scanned, ignoring wraparound for now
+                int neighbours[N_AXES] = {
+                    x > 0 && (layer[k - 1] & BOND_EAST) ? current[k - 1] : 0,
+                    y > 0 && (layer[k - n] & BOND_SOUTH) ? current[k - n] : 0,
+                    up != NULL && (up[k] & BOND_DOWN) ? above[k] : 0
+                };
+
+                int a = 0;
+                for (int d = 0; d < N_AXES; ++d)
+                {
+                    if (neighbours[d])
+                    {
+                        a = a ? cubic_labels_union(&u, a, neighbours[d], c) : cubic_labels_add(&u, neighbours[d], c);
+                    }
+                }
+                current[k] = a ? a : cubic_labels_new(&u, c);
+            }
+        }
+
+        //join clusters across the E/W and N/S edges of the layer
+        for (int y = 0; y < n; ++y)
+        {
+            coord3 c = {n - 1, y, z};
+            if (layer[(size_t) y * n + n - 1] & BOND_EAST)
+            {
+                cubic_labels_union(&u, current[(size_t) y * n + n - 1], current[(size_t) y * n], c);
+            }
+        }
+        for (int x = 0; x < n; ++x)
+        {
+            coord3 c = {x, n - 1, z};
+            if (layer[(size_t) (n - 1) * n + x] & BOND_SOUTH)
+            {
+                cubic_labels_union(&u, current[(size_t) (n - 1) * n + x], current[x], c);
+            }
+        }
+
+        if (z == s->zl)
+        {
+            memcpy(s->first, current, area * sizeof(int));
+        }
+
+        //drop clusters which can't grow any more - the first layer is kept to stitch to the slab above
+        int *layers[2] = {current, s->first};
+        if (remap_size < u.max)
+        {
+            remap = realloc(remap, u.max * sizeof(int));
+            if (remap == NULL)
+            {
+                printf("failed to alloc\n");
+                exit(EXIT_FAILURE);
+            }
+            memset(remap + remap_size, 0, (u.max - remap_size) * sizeof(int));
+            remap_size = u.max;
+        }
+        compact_cubic_labels(&u, &v, remap, layers, 2, area, s);
+
+        labels t = u;
+        u = v;
+        v = t;
+
+        int *swap = above;
+        above = current;
+        current = swap;
+    }
+
+    s->u = u;
+    s->last = above;
+
+    labels_free(&v);
+    free(remap);
+    free(current);
+}
+
+/**
+ * perform percolation analysis on the given cubic lattice, which is split into one slab of
+ * layers per thread - each slab is labelled in parallel, then the clusters reaching the edges
+ * of the slabs are stitched together across each pair of neighbouring layers
+ * check says which axes a cluster must span, spans is set to whether any cluster spans each axis
+ * returns whether lattice percolates, and the size of the max cluster
+ */
+bool percolation_cubic(cubic l, const bool *check, int64_t *max_cluster, bool *spans)
+{
+    int n = l.n;
+    size_t area = (size_t) n * n;
+
+    int num_threads;
+    #pragma omp parallel
+    num_threads = omp_get_num_threads();
+
+    //if n doesn't divide evenly, earlier slabs get 1 more layer
+    int n_slabs = MIN(num_threads, n);
+    slab *slabs = calloc(n_slabs, sizeof(slab));
+    if (slabs == NULL)
+    {
+        printf("failed to alloc\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int k = 0; k < n_slabs; ++k)
+    {
+        slabs[k].zl = k * (n / n_slabs) + MIN(k, n % n_slabs);
+        slabs[k].zu = (k + 1) * (n / n_slabs) + MIN(k + 1, n % n_slabs) - 1;
+    }
+
+    #pragma omp parallel for schedule(static)
+    for (int k = 0; k < n_slabs; ++k)
+    {
+        label_slab(l, &slabs[k]);
+    }
+
+    //gather the clusters left in every slab into one set of labels, those of slab k from offset[k] + 1 on
+    labels g;
+    cubic_labels_init(&g, n, 2 * n);
+    int *offset = malloc(n_slabs * sizeof(int));
+    if (offset == NULL)
+    {
+        printf("failed to alloc\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int k = 0; k < n_slabs; ++k)
+    {
+        offset[k] = g.count - 1;
+        for (int a = 1; a < slabs[k].u.count; ++a)
+        {
+            labels_copy(&g, &slabs[k].u, a);
+        }
+    }
+
+    //the last layer of each slab bonds down to the first of the next, wrapping around
+    for (int k = 0; k < n_slabs; ++k)
+    {
+        slab *s = &slabs[k];
+        int next = WRAP(k + 1, n_slabs);
+        site *layer = get_cubic_site(l, 0, 0, s->zu);
+
+        for (size_t j = 0; j < area; ++j)
+        {
+            if (layer[j] & BOND_DOWN)
+            {
+                coord3 c = {(int) (j % n), (int) (j / n), s->zu};
+                cubic_labels_union(&g, offset[k] + s->last[j], offset[next] + slabs[next].first[j], c);
+            }
+        }
+    }
+
+    //combine clusters which stayed in their slab with the stitched ones
+    int64_t full_max = 0;
+    for (int axis = 0; axis < N_AXES; ++axis)
+    {
+        spans[axis] = false;
+    }
+    for (int k = 0; k < n_slabs; ++k)
+    {
+        full_max = MAX(full_max, slabs[k].max);
+        for (int axis = 0; axis < N_AXES; ++axis)
+        {
+            spans[axis] |= slabs[k].spans[axis];
+        }
+    }
+    for (int a = 1; a < g.count; ++a)
+    {
+        if (g.parent[a] == a)
+        {
+            full_max = MAX(full_max, g.size[a]);
+            for (int axis = 0; axis < N_AXES; ++axis)
+            {
+                spans[axis] |= cubic_reach(&g, a, axis).len == n;
+            }
+        }
+    }
+
+    *max_cluster = full_max;
+
+    bool percolates = true;
+    for (int axis = 0; axis < N_AXES; ++axis)
+    {
+        percolates = percolates && (!check[axis] || spans[axis]);
+    }
+
+    for (int k = 0; k < n_slabs; ++k)
+    {
+        labels_free(&slabs[k].u);
+        free(slabs[k].first);
+        free(slabs[k].last);
+    }
+    labels_free(&g);
+    free(offset);
+    free(slabs);
+
+    return percolates;
+}
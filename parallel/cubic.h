@@ -0,0 +1,55 @@
+#ifndef __CUBIC_H
+#define __CUBIC_H
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <omp.h>
+#include "util.h"
+#include "lattice.h"
+#include "unionfind.h"
+#include "rng.h"
+
+//axes of a cubic lattice - x along each row, y down the rows of a layer, z down the layers
+#define AXIS_X    0
+#define AXIS_Y    1
+#define AXIS_Z    2
+#define N_AXES    3
+
+//a simple cubic lattice of packed sites (see OCCUPIED, BOND_*), stored layer by layer, each layer
+//row by row - E/S bonds are within a layer, D bonds lead to the layer below, wrapping around
+typedef struct
+{
+    site *sites;
+    int n; //dimensions
+} cubic;
+
+//coordinates of a site in a cubic lattice
+typedef struct
+{
+    int x, y, z;
+} coord3;
+
+//a run of layers labelled by one thread - only the labels of its first and last layer are kept
+typedef struct
+{
+    int zl, zu; //lower and upper z
+
+    labels u; //clusters reaching the first or last layer, with the layers they reach
+    int *first; //label of each site of the first layer, 0 if unoccupied
+    int *last; //label of each site of the last layer
+
+    int64_t max; //size of the largest cluster which never reaches the first or last layer
+    bool spans[N_AXES]; //whether such a cluster spans each axis
+} slab;
+
+cubic create_cubic(int n);
+site *get_cubic_site(cubic l, int x, int y, int z);
+void delete_cubic(cubic l);
+void seed_cubic_sites(cubic l, double p, uint64_t seed);
+void seed_cubic_bonds(cubic l, double p, uint64_t seed);
+bool percolation_cubic(cubic l, const bool *check, int64_t *max_cluster, bool *spans);
+
+#endif
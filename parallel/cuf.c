@@ -0,0 +1,83 @@
+#include "cuf.h"
+
+/**
+ * initialises n ids, each in a set of its own
+ */
+void cuf_init(cuf *u, int n)
+{
+    u->n = n;
+    u->parent = malloc(n * sizeof(int));
+    if (u->parent == NULL)
+    {
+        printf("failed to alloc\n");
+        exit(EXIT_FAILURE);
+    }
+
+    #pragma omp parallel for
+    for (int x = 0; x < n; ++x)
+    {
+        u->parent[x] = x;
+    }
+}
+
+/**
+ * cleans up memory held by a concurrent union-find
+ */
+void cuf_free(cuf *u)
+{
+    free(u->parent);
+}
+
+/**
+ * returns the canonical id of the set containing x, halving the path on the way: each
+ * id passed is pointed at its grandparent with a compare-and-swap, which is allowed to
+ * fail if another thread got there first
+ */
+int cuf_find(cuf *u, int x)
+{
+    while (true)
+    {
+        int p = __atomic_load_n(&u->parent[x], __ATOMIC_ACQUIRE);
+        if (p == x)
+        {
+            return x;
+        }
+
+        int gp = __atomic_load_n(&u->parent[p], __ATOMIC_ACQUIRE);
+        if (gp != p)
+        {
+            __atomic_compare_exchange_n(&u->parent[x], &p, gp, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+        }
+
+        x = gp;
+    }
+}
+
+/**
+ * joins the sets containing a and b - the canonical id with the higher value is linked under
+ * the other with a compare-and-swap, retrying if another thread linked it elsewhere first
+ */
+void cuf_union(cuf *u, int a, int b)
+{
+    while (true)
+    {
+        a = cuf_find(u, a);
+        b = cuf_find(u, b);
+
+        if (a == b) return;
+
+        //link higher id under lower id - swap if needed
+        if (a > b)
+        {
+            int t = a;
+            a = b;
+            b = t;
+        }
+
+        int expected = b;
+        if (__atomic_compare_exchange_n(&u->parent[b], &expected, a, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        {
+            return;
+        }
+    }
+}
@@ -0,0 +1,21 @@
+#ifndef __CUF_H
+#define __CUF_H
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+//concurrent union-find over the ids 0 .. n - 1, safe to use from many threads at once
+//without locks - sets are always linked under their lowest id, so that is the canonical id
+typedef struct
+{
+    int *parent; //parent id, an id is canonical if it is its own parent
+    int n; //number of ids
+} cuf;
+
+void cuf_init(cuf *u, int n);
+void cuf_free(cuf *u);
+int cuf_find(cuf *u, int x);
+void cuf_union(cuf *u, int a, int b);
+
+#endif
@@ -0,0 +1,272 @@
+#include "decide.h"
+
+/**
+ * records that search `id' saw the bond `key' lead to a site claimed by another thread
+ */
+void meetings_add(meetings *m, int64_t key, int id)
+{
+    if (m->count == m->max)
+    {
+        m->max = MAX(2 * m->max, 64);
+        m->data = realloc(m->data, m->max * sizeof(meeting));
+        if (m->data == NULL)
+        {
+            printf("failed to alloc\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    meeting x = {key, id};
+    m->data[m->count++] = x;
+}
+
+/**
+ * orders meetings by bond, for qsort
+ */
+int meeting_compare(const void *a, const void *b)
+{
+    int64_t x = ((const meeting *) a)->bond;
+    int64_t y = ((const meeting *) b)->bond;
+    return (x > y) - (x < y);
+}
+
+/**
+ * searches depth first out from `initial', a site on the first row (col), as search number `id'
+ * on the thread with tag `tag' - each site reached is claimed in `owner' with a compare-and-swap
+ *
+ * a thread's earlier searches never border its current one, as each finished by claiming every
+ * site it was bonded to which nobody had yet - so a site with this thread's tag is this search's,
+ * and a site with another tag belongs to a search running on another thread at the same time,
+ * in the same cluster, which sees the same bond from its side (it can only have got to its site
+ * after this one was claimed, or it would have claimed this one) - both sides log the bond in
+ * `m', and the searches are paired up afterwards
+ *
+ * rows (cols) are marked in `reached' with the number of the search reaching them, so it needs
+ * no clearing between searches - as each is connected, the ones a search reaches are a run,
+ * which it grows one row (col) at a time and leaves in `s'
+ *
+ * returns whether it alone reached every row (col), giving up as soon as `done' is set
+ */
+bool search_from(lattice l, bool along_cols, coord initial, int id, uint8_t tag, uint8_t *owner, int *reached,
+    stack *stack, meetings *m, span *s, bool *done)
+{
+    //the neighbour further down (right) is pushed last, so is explored first - a cluster which
+    //spans then heads straight for the rows (cols) it hasn't reached
+    static const int order[2][N_DIRECTIONS] = {{NORTH, EAST, WEST, SOUTH}, {NORTH, SOUTH, WEST, EAST}};
+    int n = l.n;
+
+    s->start = along_cols ? initial.j : initial.i;
+    s->len = 0;
+
+    stack->size = 0;
+    stack_push(stack, initial);
+
+    while (!stack_empty(stack) && !__atomic_load_n(done, __ATOMIC_RELAXED))
+    {
+        coord c = stack_pop(stack);
+
+        //a new row (col) is always next to the run reached so far
+        int line = along_cols ? c.j : c.i;
+        if (reached[line] != id)
+        {
+            reached[line] = id;
+            s->start = s->len > 0 && line == WRAP(s->start - 1, n) ? line : s->start;
+            if (++s->len == n)
+            {
+                return true;
+            }
+        }
+
+        for (int k = 0; k < N_DIRECTIONS; ++k)
+        {
+            int d = order[along_cols][k];
+            if (!bond(l, c, d))
+            {
+                continue;
+            }
+
+            coord next = neighbour(l, c, d);
+            uint8_t *claim = &owner[(size_t) next.i * n + next.j];
+            uint8_t o = 0;
+            if (__atomic_compare_exchange_n(claim, &o, tag, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            {
+                stack_push(stack, next);
+            }
+            else if (o != tag)
+            {
+                //bonds are kept on the site they lead E/S from
+                coord from = d == EAST || d == SOUTH ? c : next;
+                meetings_add(m, 2 * ((int64_t) from.i * n + from.j) + (d == NORTH || d == SOUTH), id);
+            }
+        }
+    }
+
+    return false;
+}
+
+/**
+ * decides whether any cluster spans every row (or every col, if along_cols), searching out from
+ * each occupied site of the first row (col) in parallel - only a cluster with a site there can
+ * span, so once every search has died out without reaching all the rows (cols), none does
+ *
+ * searches running into each other share out a cluster between them, so if none of them spans
+ * alone, they are joined up by the bonds both logged, and the runs they reached are added up for
+ * each cluster at the end
+ *
+ * sites are claimed with a byte per site holding the tag of the thread claiming it, so there can
+ * be at most DECIDE_MAX_THREADS threads
+ */
+bool spans_from_edge(lattice l, bool along_cols)
+{
+    int n = l.n;
+    bool done = false;
+    int num_threads = MIN(omp_get_max_threads(), DECIDE_MAX_THREADS);
+
+    //zeroed pages are only touched once a search reaches them
+    uint8_t *owner = calloc((size_t) n * n, sizeof(uint8_t));
+    meetings *logs = calloc(num_threads, sizeof(meetings));
+    span *spans = calloc(n, sizeof(span));
+    if (owner == NULL || logs == NULL || spans == NULL)
+    {
+        printf("failed to alloc\n");
+        exit(EXIT_FAILURE);
+    }
+
+    #pragma omp parallel num_threads(num_threads)
+    {
+        uint8_t tag = omp_get_thread_num() + 1;
+        int *reached = calloc(n, sizeof(int));
+        if (reached == NULL)
+        {
+            printf("failed to alloc\n");
+            exit(EXIT_FAILURE);
+        }
+        //searches mostly stay shallow, so the stack starts at a row and grows with the search
+        stack stack;
+        stack_init(&stack, n);
+
+        //once any search spans, the rest are skipped
+        #pragma omp for schedule(dynamic, 16)
+        for (int k = 0; k < n; ++k)
+        {
+            coord initial = {along_cols ? k : 0, along_cols ? 0 : k};
+            uint8_t o = 0;
+
+            if (__atomic_load_n(&done, __ATOMIC_RELAXED) || !(*get_site(l, initial.i, initial.j) & OCCUPIED)
+                || !__atomic_compare_exchange_n(&owner[(size_t) initial.i * n + initial.j], &o, tag, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            {
+                continue;
+            }
+
+            if (search_from(l, along_cols, initial, k + 1, tag, owner, reached, &stack, &logs[tag - 1], &spans[k], &done))
+            {
+                __atomic_store_n(&done, true, __ATOMIC_RELAXED);
+            }
+        }
+
+        free(reached);
+        stack_free(&stack);
+    }
+    free(owner);
+
+    //add up the runs of searches which shared a cluster, into a bitset for each cluster
+    if (!done)
+    {
+        //gather every thread's log, so the two sides of each bond end up next to each other
+        size_t count = 0;
+        for (int t = 0; t < num_threads; ++t)
+        {
+            count += logs[t].count;
+        }
+
+        meeting *all = malloc(MAX(count, 1) * sizeof(meeting));
+        cuf u;
+        cuf_init(&u, n);
+        bool *met = calloc(n, sizeof(bool));
+        int *slot = malloc(n * sizeof(int));
+        uint64_t *bits = NULL;
+        int n_slots = 0;
+        if (all == NULL || met == NULL || slot == NULL)
+        {
+            printf("failed to alloc\n");
+            exit(EXIT_FAILURE);
+        }
+
+        count = 0;
+        for (int t = 0; t < num_threads; ++t)
+        {
+            memcpy(&all[count], logs[t].data, logs[t].count * sizeof(meeting));
+            count += logs[t].count;
+        }
+        qsort(all, count, sizeof(meeting), meeting_compare);
+
+        for (size_t x = 1; x < count; ++x)
+        {
+            if (all[x].bond == all[x - 1].bond)
+            {
+                cuf_union(&u, all[x].search - 1, all[x - 1].search - 1);
+                met[all[x].search - 1] = true;
+                met[all[x - 1].search - 1] = true;
+            }
+        }
+
+        for (int k = 0; k < n; ++k)
+        {
+            slot[k] = -1;
+        }
+
+        for (int k = 0; k < n && !done; ++k)
+        {
+            if (!met[k])
+            {
+                continue;
+            }
+
+            //the first search found of each cluster makes room for its bitset
+            int root = cuf_find(&u, k);
+            if (slot[root] < 0)
+            {
+                slot[root] = n_slots++;
+                bits = realloc(bits, (size_t) n_slots * BITSET_WORDS(n) * sizeof(uint64_t));
+                if (bits == NULL)
+                {
+                    printf("failed to alloc\n");
+                    exit(EXIT_FAILURE);
+                }
+                memset(&bits[(size_t) slot[root] * BITSET_WORDS(n)], 0, BITSET_WORDS(n) * sizeof(uint64_t));
+            }
+
+            uint64_t *b = &bits[(size_t) slot[root] * BITSET_WORDS(n)];
+            for (int x = 0; x < spans[k].len; ++x)
+            {
+                bitset_set(b, WRAP(spans[k].start + x, n));
+            }
+            done = bitset_full(b, n);
+        }
+
+        cuf_free(&u);
+        free(all);
+        free(met);
+        free(slot);
+        free(bits);
+    }
+
+    for (int t = 0; t < num_threads; ++t)
+    {
+        free(logs[t].data);
+    }
+    free(logs);
+    free(spans);
+
+    return done;
+}
+
+/**
+ * decides whether a lattice percolates (row, col, both) without labelling every cluster or finding
+ * the largest, by searching out from the first row (col) - as soon as a search is found to span,
+ * the others are called off
+ */
+bool percolation_decide(lattice l, bool rows, bool cols)
+{
+    return (!rows || spans_from_edge(l, false)) && (!cols || spans_from_edge(l, true));
+}
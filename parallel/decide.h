@@ -0,0 +1,35 @@
+#ifndef __DECIDE_H
+#define __DECIDE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+#include "util.h"
+#include "lattice.h"
+#include "stack.h"
+#include "cuf.h"
+
+//most threads a decision runs on - each claims sites with its own byte-sized tag, 0 being unclaimed
+#define DECIDE_MAX_THREADS 255
+
+//a bond between sites claimed by searches on different threads, as seen from one side
+typedef struct
+{
+    int64_t bond; //2 x the index of the site the bond leads E/S from, + 1 if it leads S
+    int search; //number of the search which saw it
+} meeting;
+
+//bonds seen by the searches of one thread, each of which the search on the other side also sees
+typedef struct
+{
+    meeting *data;
+    size_t count;
+    size_t max;
+} meetings;
+
+bool percolation_decide(lattice l, bool rows, bool cols);
+
+#endif
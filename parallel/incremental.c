@@ -0,0 +1,643 @@
+#include "incremental.h"
+
+/**
+ * index of a site in the per-site arrays
+ */
+size_t site_index(incremental *s, coord c)
+{
+    return (size_t) c.i * s->l.n + c.j;
+}
+
+/**
+ * appends a site onto the sites reached by search k, growing its array if needed
+ */
+void found_push(incremental *s, int k, coord c)
+{
+    if (s->n_found[k] == s->capacity[k])
+    {
+        s->capacity[k] = MAX(2 * s->capacity[k], 64);
+        s->found[k] = realloc(s->found[k], s->capacity[k] * sizeof(coord));
+        if (s->found[k] == NULL)
+        {
+            printf("failed to alloc\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    s->found[k][s->n_found[k]++] = c;
+}
+
+/**
+ * hands out MAX_SEARCHES stamps which no site holds yet, returning the first
+ */
+uint32_t new_stamps(incremental *s)
+{
+    //start again from scratch once the stamps run out
+    if (s->next_stamp > UINT32_MAX - MAX_SEARCHES)
+    {
+        memset(s->stamp, 0, (size_t) s->l.n * s->l.n * sizeof(uint32_t));
+        s->next_stamp = 1;
+    }
+
+    uint32_t first = s->next_stamp;
+    s->next_stamp += MAX_SEARCHES;
+    return first;
+}
+
+/**
+ * changes the size of cluster a, keeping the count of clusters of each size and the max up to date
+ *
+ * the new size is counted before the old one is taken away, so the max only ever steps down
+ * as far as the larger of the new size and the next largest cluster
+ */
+void resize_cluster(incremental *s, int a, int64_t size)
+{
+    if (size > 0)
+    {
+        ++s->of_size[size];
+        s->max = MAX(s->max, size);
+    }
+    if (s->size[a] > 0)
+    {
+        --s->of_size[s->size[a]];
+    }
+    s->size[a] = size;
+
+    while (s->max > 0 && s->of_size[s->max] == 0)
+    {
+        --s->max;
+    }
+}
+
+/**
+ * starts counting the sites of cluster a in each row and col, from zero - the caller counts them in
+ */
+void track(incremental *s, int a)
+{
+    int n = s->l.n;
+
+    if (s->n_free_slots == 0)
+    {
+        //at most n clusters have n sites or more at once, so the slots stop growing at n
+        int slots = MIN(MAX(2 * s->n_slots, 1), n);
+        s->counts = realloc(s->counts, (size_t) slots * 2 * n * sizeof(int));
+        s->reached = realloc(s->reached, (size_t) slots * 2 * sizeof(int));
+        if (s->counts == NULL || s->reached == NULL)
+        {
+            printf("failed to alloc\n");
+            exit(EXIT_FAILURE);
+        }
+        for (int k = slots - 1; k >= s->n_slots; --k)
+        {
+            s->free_slots[s->n_free_slots++] = k;
+        }
+        s->n_slots = slots;
+    }
+
+    int k = s->free_slots[--s->n_free_slots];
+    memset(&s->counts[(size_t) k * 2 * n], 0, 2 * n * sizeof(int));
+    s->reached[2 * k] = s->reached[2 * k + 1] = 0;
+    s->slot[a] = k;
+}
+
+/**
+ * stops counting the sites of cluster a in each row and col
+ */
+void untrack(incremental *s, int a)
+{
+    int k = s->slot[a];
+    s->spans_rows -= s->reached[2 * k] == s->l.n;
+    s->spans_cols -= s->reached[2 * k + 1] == s->l.n;
+    s->free_slots[s->n_free_slots++] = k;
+    s->slot[a] = -1;
+}
+
+/**
+ * adds (delta = 1) or takes away (delta = -1) the site c from the row/col counts of cluster a, if it has them
+ */
+void count_site(incremental *s, int a, coord c, int delta)
+{
+    int k = s->slot[a];
+    if (k < 0)
+    {
+        return;
+    }
+
+    int n = s->l.n;
+    int *counts = &s->counts[(size_t) k * 2 * n];
+    int x[2] = {c.i, n + c.j};
+
+    for (int axis = 0; axis < 2; ++axis)
+    {
+        int *reached = &s->reached[2 * k + axis];
+        int *spans = axis == 0 ? &s->spans_rows : &s->spans_cols;
+
+        //rows (cols) reached only change with the first site to arrive in one or the last to leave
+        if (delta > 0 && counts[x[axis]]++ == 0 && ++*reached == n)
+        {
+            ++*spans;
+        }
+        else if (delta < 0 && --counts[x[axis]] == 0 && (*reached)-- == n)
+        {
+            --*spans;
+        }
+    }
+}
+
+/**
+ * hands out an id for a new, empty cluster
+ */
+int new_cluster(incremental *s)
+{
+    int a = s->free_ids[--s->n_free_ids];
+    s->size[a] = 0;
+    s->slot[a] = -1;
+    return a;
+}
+
+/**
+ * gives back the id of a cluster which has no sites left
+ */
+void delete_cluster(incremental *s, int a)
+{
+    if (s->slot[a] >= 0)
+    {
+        untrack(s, a);
+    }
+    resize_cluster(s, a, 0);
+    s->free_ids[s->n_free_ids++] = a;
+}
+
+/**
+ * finds every site connected to `start` by a breadth first search, into the sites found by search k
+ */
+void gather(incremental *s, coord start, int k)
+{
+    uint32_t mark = new_stamps(s);
+
+    s->n_found[k] = 0;
+    s->stamp[site_index(s, start)] = mark;
+    found_push(s, k, start);
+
+    for (size_t head = 0; head < s->n_found[k]; ++head)
+    {
+        coord c = s->found[k][head];
+        for (int d = 0; d < N_DIRECTIONS; ++d)
+        {
+            if (!bond(s->l, c, d))
+            {
+                continue;
+            }
+
+            coord y = neighbour(s->l, c, d);
+            if (s->stamp[site_index(s, y)] != mark)
+            {
+                s->stamp[site_index(s, y)] = mark;
+                found_push(s, k, y);
+            }
+        }
+    }
+}
+
+/**
+ * gives cluster a, which the k-th search found all of, row/col counts if it is big enough to span
+ */
+void track_if_big(incremental *s, int a, int k)
+{
+    if (s->size[a] < s->l.n || s->slot[a] >= 0)
+    {
+        return;
+    }
+
+    track(s, a);
+    for (size_t x = 0; x < s->n_found[k]; ++x)
+    {
+        count_site(s, a, s->found[k][x], 1);
+    }
+}
+
+/**
+ * joins the clusters of two sites which have just been bonded, by relabelling the smaller one
+ */
+void join(incremental *s, coord x, coord y)
+{
+    int a = s->id[site_index(s, x)];
+    int b = s->id[site_index(s, y)];
+
+    if (a == b)
+    {
+        return;
+    }
+
+    //relabel b, the smaller - swap if needed
+    if (s->size[a] < s->size[b])
+    {
+        int t = a;
+        a = b;
+        b = t;
+        coord c = x;
+        x = y;
+        y = c;
+    }
+
+    //the counts of b go with it, and its sites are counted again as they join a
+    int64_t size_b = s->size[b];
+    if (s->slot[b] >= 0)
+    {
+        untrack(s, b);
+    }
+
+    //breadth first search over the sites of b, which it finds by their old id
+    s->n_found[0] = 0;
+    s->id[site_index(s, y)] = a;
+    found_push(s, 0, y);
+    for (size_t head = 0; head < s->n_found[0]; ++head)
+    {
+        coord c = s->found[0][head];
+        count_site(s, a, c, 1);
+
+        for (int d = 0; d < N_DIRECTIONS; ++d)
+        {
+            if (!bond(s->l, c, d))
+            {
+                continue;
+            }
+
+            coord z = neighbour(s->l, c, d);
+            if (s->id[site_index(s, z)] == b)
+            {
+                s->id[site_index(s, z)] = a;
+                found_push(s, 0, z);
+            }
+        }
+    }
+
+    resize_cluster(s, a, s->size[a] + size_b);
+    delete_cluster(s, b);
+
+    //only just big enough to span - all of it has to be counted
+    if (s->size[a] >= s->l.n && s->slot[a] < 0)
+    {
+        gather(s, x, 0);
+        track_if_big(s, a, 0);
+    }
+}
+
+/**
+ * the group the k-th search belongs to, once the searches which met have been grouped together
+ */
+int search_group(const int *group, int k)
+{
+    while (group[k] != k)
+    {
+        k = group[k];
+    }
+    return k;
+}
+
+/**
+ * moves the sites found by the searches in group g out of cluster a, into a new cluster of their own
+ */
+void cut_piece(incremental *s, int a, const int *group, int n_searches, int g)
+{
+    int b = new_cluster(s);
+    int64_t size = 0;
+
+    for (int k = 0; k < n_searches; ++k)
+    {
+        if (search_group(group, k) != g)
+        {
+            continue;
+        }
+
+        for (size_t x = 0; x < s->n_found[k]; ++x)
+        {
+            coord c = s->found[k][x];
+            s->id[site_index(s, c)] = b;
+            count_site(s, a, c, -1);
+        }
+        size += s->n_found[k];
+    }
+
+    resize_cluster(s, b, size);
+    resize_cluster(s, a, s->size[a] - size);
+
+    //big enough to span - the sites just moved are all of it
+    if (size >= s->l.n)
+    {
+        track(s, b);
+        for (int k = 0; k < n_searches; ++k)
+        {
+            for (size_t x = 0; search_group(group, k) == g && x < s->n_found[k]; ++x)
+            {
+                count_site(s, b, s->found[k][x], 1);
+            }
+        }
+    }
+}
+
+/**
+ * after cluster a has lost a site or bond, works out which of the sites it was joined to through
+ * it are still connected - a breadth first search runs from each, taking one step of each in turn
+ *
+ * searches which meet are grouped together, and a group whose searches all run out before the
+ * others is a piece cut off from the rest, which is given a new id - the searches stop once only
+ * one group is left going, which keeps id a, so the work done is in proportion to the pieces cut
+ * off rather than to the whole cluster
+ */
+void split(incremental *s, int a, const coord *starts, int n_searches)
+{
+    int group[MAX_SEARCHES];
+    bool cut[MAX_SEARCHES];
+    size_t head[MAX_SEARCHES];
+    uint32_t base = new_stamps(s);
+
+    for (int k = 0; k < n_searches; ++k)
+    {
+        group[k] = k;
+        cut[k] = false;
+        head[k] = 0;
+        s->n_found[k] = 0;
+        s->stamp[site_index(s, starts[k])] = base + k;
+        found_push(s, k, starts[k]);
+    }
+
+    //groups neither joined onto another nor cut off
+    int live = n_searches;
+    while (live > 1)
+    {
+        for (int k = 0; k < n_searches; ++k)
+        {
+            if (head[k] == s->n_found[k])
+            {
+                continue;
+            }
+
+            coord c = s->found[k][head[k]++];
+            for (int d = 0; d < N_DIRECTIONS; ++d)
+            {
+                if (!bond(s->l, c, d))
+                {
+                    continue;
+                }
+
+                coord y = neighbour(s->l, c, d);
+                uint32_t t = s->stamp[site_index(s, y)];
+
+                //already reached by one of the searches - if another, they are in the same piece
+                if (t >= base && t < base + n_searches)
+                {
+                    int g = search_group(group, k);
+                    int h = search_group(group, t - base);
+                    if (g != h)
+                    {
+                        group[h] = g;
+                        --live;
+                    }
+                    continue;
+                }
+
+                s->stamp[site_index(s, y)] = base + k;
+                found_push(s, k, y);
+            }
+        }
+
+        //groups whose searches have all run out are cut off from the rest
+        for (int g = 0; g < n_searches && live > 1; ++g)
+        {
+            bool done = search_group(group, g) == g && !cut[g];
+            for (int k = 0; k < n_searches && done; ++k)
+            {
+                done = search_group(group, k) != g || head[k] == s->n_found[k];
+            }
+
+            if (done)
+            {
+                cut_piece(s, a, group, n_searches, g);
+                cut[g] = true;
+                --live;
+            }
+        }
+    }
+
+    //what is left may have become too small to span
+    if (s->slot[a] >= 0 && s->size[a] < s->l.n)
+    {
+        untrack(s, a);
+    }
+}
+
+/**
+ * marks a site occupied, as a cluster of its own with no bonds yet
+ */
+void occupy(incremental *s, coord c)
+{
+    *get_site(s->l, c.i, c.j) |= OCCUPIED;
+
+    int a = new_cluster(s);
+    s->id[site_index(s, c)] = a;
+    resize_cluster(s, a, 1);
+}
+
+/**
+ * sets up the clusters of a lattice, as it is now, with one breadth first search of each
+ * - later changes made through the incremental_ functions are written into its sites
+ */
+void incremental_init(incremental *s, lattice l)
+{
+    size_t sites = (size_t) l.n * l.n;
+    s->l = l;
+
+    s->id = malloc(sites * sizeof(int));
+    s->size = malloc(sites * sizeof(int64_t));
+    s->slot = malloc(sites * sizeof(int));
+    s->free_ids = malloc(sites * sizeof(int));
+    s->free_slots = malloc(l.n * sizeof(int));
+    s->of_size = calloc(sites + 1, sizeof(int64_t));
+    s->stamp = calloc(sites, sizeof(uint32_t));
+    if (s->id == NULL || s->size == NULL || s->slot == NULL || s->free_ids == NULL || s->free_slots == NULL
+        || s->of_size == NULL || s->stamp == NULL)
+    {
+        printf("failed to alloc\n");
+        exit(EXIT_FAILURE);
+    }
+
+    //ids are handed out from the end, so lowest first
+    for (size_t k = 0; k < sites; ++k)
+    {
+        s->id[k] = -1;
+        s->free_ids[k] = (int) (sites - 1 - k);
+    }
+    s->n_free_ids = (int) sites;
+
+    s->counts = NULL;
+    s->reached = NULL;
+    s->n_slots = s->n_free_slots = 0;
+
+    for (int k = 0; k < MAX_SEARCHES; ++k)
+    {
+        s->found[k] = NULL;
+        s->n_found[k] = s->capacity[k] = 0;
+    }
+    s->next_stamp = 1;
+
+    s->max = 0;
+    s->spans_rows = s->spans_cols = 0;
+
+    //label each cluster already in the lattice from the first of its sites
+    for (size_t k = 0; k < sites; ++k)
+    {
+        if (!(l.sites[k] & OCCUPIED) || s->id[k] >= 0)
+        {
+            continue;
+        }
+
+        coord c = {(int) (k / l.n), (int) (k % l.n)};
+        gather(s, c, 0);
+
+        int a = new_cluster(s);
+        for (size_t x = 0; x < s->n_found[0]; ++x)
+        {
+            s->id[site_index(s, s->found[0][x])] = a;
+        }
+        resize_cluster(s, a, s->n_found[0]);
+        track_if_big(s, a, 0);
+    }
+}
+
+/**
+ * cleans up memory held for keeping the clusters up to date - the lattice itself is left alone
+ */
+void incremental_free(incremental *s)
+{
+    free(s->id);
+    free(s->size);
+    free(s->slot);
+    free(s->free_ids);
+    free(s->counts);
+    free(s->reached);
+    free(s->free_slots);
+    free(s->of_size);
+    free(s->stamp);
+    for (int k = 0; k < MAX_SEARCHES; ++k)
+    {
+        free(s->found[k]);
+    }
+}
+
+/**
+ * occupies a site as in site percolation, with bonds to each occupied neighbour
+ */
+void incremental_open_site(incremental *s, coord c)
+{
+    if (*get_site(s->l, c.i, c.j) & OCCUPIED)
+    {
+        return;
+    }
+
+    occupy(s, c);
+    for (int d = 0; d < N_DIRECTIONS; ++d)
+    {
+        coord y = neighbour(s->l, c, d);
+        if (*get_site(s->l, y.i, y.j) & OCCUPIED)
+        {
+            set_bond(s->l, c, d, true);
+            join(s, c, y);
+        }
+    }
+}
+
+/**
+ * empties a site, along with all of its bonds
+ */
+void incremental_close_site(incremental *s, coord c)
+{
+    site *here = get_site(s->l, c.i, c.j);
+    if (!(*here & OCCUPIED))
+    {
+        return;
+    }
+
+    int a = s->id[site_index(s, c)];
+
+    //the sites it was bonded to, each once (the N and S neighbours are the same for n = 2)
+    coord starts[MAX_SEARCHES];
+    int n_starts = 0;
+    for (int d = 0; d < N_DIRECTIONS; ++d)
+    {
+        if (!bond(s->l, c, d))
+        {
+            continue;
+        }
+
+        coord y = neighbour(s->l, c, d);
+        set_bond(s->l, c, d, false);
+
+        bool seen = false;
+        for (int k = 0; k < n_starts; ++k)
+        {
+            seen |= starts[k].i == y.i && starts[k].j == y.j;
+        }
+        if (!seen)
+        {
+            starts[n_starts++] = y;
+        }
+    }
+
+    *here &= ~OCCUPIED;
+    s->id[site_index(s, c)] = -1;
+    count_site(s, a, c, -1);
+
+    if (s->size[a] == 1)
+    {
+        delete_cluster(s, a);
+        return;
+    }
+
+    resize_cluster(s, a, s->size[a] - 1);
+    split(s, a, starts, n_starts);
+}
+
+/**
+ * adds a bond from a site to its neighbour in a given direction as in bond percolation,
+ * occupying either end if it wasn't already
+ */
+void incremental_open_bond(incremental *s, coord c, int dir)
+{
+    coord y = neighbour(s->l, c, dir);
+
+    if (!(*get_site(s->l, c.i, c.j) & OCCUPIED))
+    {
+        occupy(s, c);
+    }
+    if (!(*get_site(s->l, y.i, y.j) & OCCUPIED))
+    {
+        occupy(s, y);
+    }
+
+    set_bond(s->l, c, dir, true);
+    join(s, c, y);
+}
+
+/**
+ * takes away the bond from a site to its neighbour in a given direction - both ends stay occupied
+ */
+void incremental_close_bond(incremental *s, coord c, int dir)
+{
+    if (!bond(s->l, c, dir))
+    {
+        return;
+    }
+
+    set_bond(s->l, c, dir, false);
+
+    coord starts[2] = {c, neighbour(s->l, c, dir)};
+    split(s, s->id[site_index(s, c)], starts, 2);
+}
+
+/**
+ * whether the lattice percolates as it is now, checking rows and/or cols as for percolation()
+ */
+bool incremental_percolates(incremental *s, bool rows, bool cols)
+{
+    return (!rows || s->spans_rows > 0) && (!cols || s->spans_cols > 0);
+}
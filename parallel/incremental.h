@@ -0,0 +1,58 @@
+#ifndef __INCREMENTAL_H
+#define __INCREMENTAL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "util.h"
+#include "lattice.h"
+
+//most searches run side by side when a site or bond is closed, one from each site it was bonded to
+#define MAX_SEARCHES N_DIRECTIONS
+
+//a lattice whose clusters are kept labelled as sites and bonds are opened and closed one at a
+//time, so each change takes time in proportion to the clusters it touches rather than n^2
+//
+//each site holds the id of its cluster directly, and joining two clusters relabels the smaller
+//one (union by size), so when a cluster splits the pieces found can be given new ids without
+//touching the rest of it - clusters of at least n sites, the only ones which can span, also
+//count their sites in each row and col, so whether they still span is known without a search
+typedef struct
+{
+    lattice l; //sites and bonds, kept up to date - not owned, and can still be passed to percolation()
+
+    int *id; //cluster of each site, -1 while unoccupied
+    int64_t *size; //number of sites in each cluster
+    int *slot; //slot of the row/col counts of each cluster, or -1 if it has fewer than n sites
+    int *free_ids; //cluster ids not in use, to hand out next from the end
+    int n_free_ids;
+
+    int *counts; //2n counts for each slot: sites of its cluster in each row, then in each col
+    int *reached; //2 for each slot: number of rows, then cols holding any sites of its cluster
+    int *free_slots; //slots not in use
+    int n_slots, n_free_slots; //slots allocated so far, and how many of them are free
+
+    int64_t *of_size; //number of clusters of each size 0, ..., n^2
+    int64_t max; //size of the largest cluster
+    int spans_rows, spans_cols; //number of clusters reaching every row, and every col
+
+    //sites reached by each search, in the order found - a search marks the sites it reaches
+    //with its own stamp, so meeting another search is spotted straight away
+    coord *found[MAX_SEARCHES];
+    size_t n_found[MAX_SEARCHES];
+    size_t capacity[MAX_SEARCHES];
+    uint32_t *stamp;
+    uint32_t next_stamp;
+} incremental;
+
+void incremental_init(incremental *s, lattice l);
+void incremental_free(incremental *s);
+void incremental_open_site(incremental *s, coord c);
+void incremental_close_site(incremental *s, coord c);
+void incremental_open_bond(incremental *s, coord c, int dir);
+void incremental_close_bond(incremental *s, coord c, int dir);
+bool incremental_percolates(incremental *s, bool rows, bool cols);
+
+#endif
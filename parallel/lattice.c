@@ -1,29 +1,93 @@
+//for mmap
+#define _POSIX_C_SOURCE 200809L
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "lattice.h"
 
+#ifdef HAVE_AVX2
+#include <immintrin.h>
+#endif
+
 /**
  * given a cluster which may be linked to other clusters, returns
- * the canonical cluster
+ * the canonical cluster - everything on the way is then linked straight to it,
+ * with its offset to the canonical cluster's coordinates
  */
 cluster *canonical(cluster *c)
 {
-    while (c->redirect != NULL)
+    cluster *root = c;
+    int di = 0, dj = 0;
+    while (root->redirect != NULL)
     {
-        c = c->redirect;
+        di += root->di;
+        dj += root->dj;
+        root = root->redirect;
     }
-    return c;
+
+    //offset of each cluster on the path is what is left of the total once past it
+    while (c != root)
+    {
+        cluster *next = c->redirect;
+        int next_di = di - c->di;
+        int next_dj = dj - c->dj;
+
+        c->redirect = root;
+        c->di = di;
+        c->dj = dj;
+
+        c = next;
+        di = next_di;
+        dj = next_dj;
+    }
+    return root;
+}
+
+/**
+ * adds the moments of a cluster of `size` sites onto another's, shifting its
+ * coordinates by (di, dj) on the way
+ */
+void add_moments(double *into, const double *from, int64_t size, int di, int dj)
+{
+    into[MOMENT_II] += from[MOMENT_II] + 2.0 * di * from[MOMENT_I] + (double) size * di * di;
+    into[MOMENT_JJ] += from[MOMENT_JJ] + 2.0 * dj * from[MOMENT_J] + (double) size * dj * dj;
+    into[MOMENT_I] += from[MOMENT_I] + (double) size * di;
+    into[MOMENT_J] += from[MOMENT_J] + (double) size * dj;
 }
 
 /**
  * specifies that two clusters are actually the same (due to
- * wraparound connections or different boxes)
+ * wraparound connections or different boxes), where a site of b is bonded to a
+ * site of a which is at its coordinates plus (di, dj) - nonzero only across the
+ * periodic edges of the lattice
  */
-void merge_clusters(lattice l, cluster *a, cluster *b)
+void merge_clusters(lattice l, cluster *a, cluster *b, int di, int dj)
 {
-    //find canonical clusters
-    a = canonical(a);
-    b = canonical(b);
+    //find canonical clusters, and the offset from the coordinates of b's to a's
+    cluster *ca = canonical(a);
+    cluster *cb = canonical(b);
+    if (a != ca)
+    {
+        di += a->di;
+        dj += a->dj;
+    }
+    if (b != cb)
+    {
+        di -= b->di;
+        dj -= b->dj;
+    }
+    a = ca;
+    b = cb;
 
-    if (a->id == b->id) return;
+    //joined to itself by a path which doesn't come back to the same coordinates - winds round the lattice
+    if (a->id == b->id)
+    {
+        a->wraps |= di != 0 || dj != 0;
+        return;
+    }
 
     //merge one with higher id into one with lower id - swap if needed
     if (a->id > b->id)
@@ -31,55 +95,49 @@ void merge_clusters(lattice l, cluster *a, cluster *b)
         cluster *c = a;
         a = b;
         b = c;
+        di = -di;
+        dj = -dj;
     }
 
     //link b to a
     b->redirect = a;
+    b->di = di;
+    b->dj = dj;
 
-    //increase the size of a
+    //increase the size of a, and bring in the sites of b
+    add_moments(a->moments, b->moments, b->size, di, dj);
     a->size += b->size;
+    a->wraps |= b->wraps;
 
     //link the reached rows/columns of b into a
-    for (int i = 0; i < l.n; ++i)
-    {
-        a->rows[i] |= b->rows[i];
-        a->cols[i] |= b->cols[i];
-    }
-
-    //b data not needed any more - clear memory
-    free(b->rows);
-    free(b->cols);
+    bitset_or(a->rows, b->rows, l.n);
+    bitset_or(a->cols, b->cols, l.n);
 }
 
 /**
  * returns a new empty square lattice of size n by n
+ *
+ * the rows are cleared in parallel, split into one block per thread in order - the same split as
+ * seeding and the strips labelled by percolation() use - so that each page is first touched, and
+ * so placed on the NUMA node of, the thread which goes on to use it
  */
 lattice create_lattice(int n)
 {
     lattice l;
     l.n = n;
 
-    l.sites = malloc(n * sizeof(site *));
+    l.mapped = 0;
+    l.sites = malloc((size_t) n * n * sizeof(site));
     if (l.sites == NULL)
     {
         printf("failed to alloc\n");
         exit(EXIT_FAILURE);
     }
 
+    #pragma omp parallel for schedule(static)
     for (int i = 0; i < n; ++i)
     {
-        l.sites[i] = calloc(n, sizeof(site));
-        if (l.sites[i] == NULL)
-        {
-            printf("failed to alloc\n");
-            exit(EXIT_FAILURE);
-        }
-
-        for (int j = 0; j < n; ++j)
-        {
-            l.sites[i][j].i = i;
-            l.sites[i][j].j = j;
-        }
+        memset(get_site(l, i, 0), 0, n * sizeof(site));
     }
 
     return l;
@@ -90,7 +148,7 @@ lattice create_lattice(int n)
  */
 site *get_site(lattice l, int i, int j)
 {
-  return l.sites[i] + j;
+  return l.sites + (size_t) i * l.n + j;
 }
 
 /**
@@ -98,81 +156,344 @@ site *get_site(lattice l, int i, int j)
  */
 void delete_lattice(lattice l)
 {
-    for (int i = 0; i < l.n; ++i)
+    if (l.mapped > 0)
     {
-        free(l.sites[i]);
+        munmap(l.sites - sizeof(lattice_header), l.mapped);
+    }
+    else
+    {
+        free(l.sites);
     }
-    free(l.sites);
 }
 
 /**
- * returns the direction opposite to the one given
+ * returns the coordinates of the neighbour of a given site in a given direction
  */
-int reverse(int dir)
+coord neighbour(lattice l, coord c, int dir)
 {
-    return (dir + N_DIRECTIONS / 2) % N_DIRECTIONS;
+    static const int i_offset[N_DIRECTIONS] = {-1, 0, 1, 0};
+    static const int j_offset[N_DIRECTIONS] = {0, 1, 0, -1};
+    coord n = {WRAP(c.i + i_offset[dir], l.n), WRAP(c.j + j_offset[dir], l.n)};
+    return n;
 }
 
 /**
- * returns a pointer to the neighbour of a given site in a given direction
+ * checks whether a site has a bond to its neighbour in a given direction - only
+ * E/S bonds are stored, so N/W bonds are looked up on the neighbour
  */
-site *neighbour(lattice l, site *s, int dir)
+bool bond(lattice l, coord c, int dir)
 {
-    int i_offset[N_DIRECTIONS] = {-1, 0, 1, 0};
-    int j_offset[N_DIRECTIONS] = {0, 1, 0, -1};
-    return &(l.sites[mod_p(s->i + i_offset[dir], l.n)][mod_p(s->j + j_offset[dir], l.n)]);
+    switch (dir)
+    {
+        case NORTH:
+            return *get_site(l, WRAP(c.i - 1, l.n), c.j) & BOND_SOUTH;
+        case EAST:
+            return *get_site(l, c.i, c.j) & BOND_EAST;
+        case SOUTH:
+            return *get_site(l, c.i, c.j) & BOND_SOUTH;
+        default:
+            return *get_site(l, c.i, WRAP(c.j - 1, l.n)) & BOND_EAST;
+    }
 }
 
 /**
- * seeds the sites of a lattice with probability p, and forms bonds appropriately
+ * sets or clears the bond from a site to its neighbour in a given direction
  */
-void seed_sites(lattice l, double p)
+void set_bond(lattice l, coord c, int dir, bool on)
 {
-    for (int i = 0; i < l.n; ++i)
+    //N/W bonds are stored as the S/E bonds of the neighbour
+    coord at = dir == NORTH || dir == WEST ? neighbour(l, c, dir) : c;
+    site bit = dir == NORTH || dir == SOUTH ? BOND_SOUTH : BOND_EAST;
+    site *x = get_site(l, at.i, at.j);
+    *x = on ? *x | bit : *x & ~bit;
+}
+
+#ifdef HAVE_AVX2
+/**
+ * mask_row for as many whole groups of 32 sites as fit in the row - returns how many were done
+ */
+__attribute__((target("avx2")))
+int mask_row_avx2(site *row, const uint32_t *r, int n, uint64_t threshold, site bit)
+{
+    //p = 1 has a threshold past any 32 bit number, so is left to the scalar code
+    if (threshold > UINT32_MAX)
     {
-        for (int j = 0; j < l.n; ++j)
+        return 0;
+    }
+
+    //unsigned compare as a signed one, with the top bits flipped
+    const __m256i flip = _mm256_set1_epi32((int) 0x80000000u);
+    const __m256i limit = _mm256_set1_epi32((int) ((uint32_t) threshold ^ 0x80000000u));
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    const __m256i bits = _mm256_set1_epi8((char) bit);
+
+    int j = 0;
+    for (; j + 32 <= n; j += 32)
+    {
+        __m256i below[4];
+        for (int k = 0; k < 4; ++k)
         {
-            double curr = (double) rand() / RAND_MAX;
-            l.sites[i][j].occupied = curr < p;
+            __m256i x = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *) (r + j + 8 * k)), flip);
+            below[k] = _mm256_cmpgt_epi32(limit, x);
         }
+
+        //narrow the 32 bit masks to bytes - packing works within 128 bit halves, so put them back in order
+        __m256i mask = _mm256_packs_epi16(_mm256_packs_epi32(below[0], below[1]), _mm256_packs_epi32(below[2], below[3]));
+        mask = _mm256_permutevar8x32_epi32(mask, order);
+
+        __m256i sites = _mm256_loadu_si256((const __m256i *) (row + j));
+        _mm256_storeu_si256((__m256i *) (row + j), _mm256_or_si256(sites, _mm256_and_si256(mask, bits)));
+    }
+
+    return j;
+}
+
+/**
+ * site_bonds_row for whole groups of 32 sites which have their E neighbour in the same group
+ * or the next - returns how many were done
+ */
+__attribute__((target("avx2")))
+int site_bonds_row_avx2(site *row, const site *below, int n)
+{
+    const __m256i occupied = _mm256_set1_epi8(OCCUPIED);
+
+    int j = 0;
+    for (; j + 32 < n; j += 32)
+    {
+        __m256i here = _mm256_loadu_si256((const __m256i *) (row + j));
+        __m256i east = _mm256_loadu_si256((const __m256i *) (row + j + 1));
+        __m256i south = _mm256_loadu_si256((const __m256i *) (below + j));
+
+        //the OCCUPIED bit of both ends of a bond, doubled once to BOND_EAST or twice to BOND_SOUTH
+        __m256i e = _mm256_and_si256(_mm256_and_si256(here, east), occupied);
+        __m256i s = _mm256_and_si256(_mm256_and_si256(here, south), occupied);
+        e = _mm256_add_epi8(e, e);
+        s = _mm256_add_epi8(s, s);
+        s = _mm256_add_epi8(s, s);
+
+        _mm256_storeu_si256((__m256i *) (row + j), _mm256_or_si256(here, _mm256_or_si256(e, s)));
+    }
+
+    return j;
+}
+
+/**
+ * bond_sites_row for whole groups of 32 sites from the second site on, which have their W
+ * neighbour in the row without wrapping around - returns the first site not done
+ */
+__attribute__((target("avx2")))
+int bond_sites_row_avx2(site *row, const site *above, int n)
+{
+    const __m256i east = _mm256_set1_epi8(BOND_EAST);
+    const __m256i south = _mm256_set1_epi8(BOND_SOUTH);
+    const __m256i both = _mm256_set1_epi8(BOND_EAST | BOND_SOUTH);
+    const __m256i occupied = _mm256_set1_epi8(OCCUPIED);
+
+    int j = 1;
+    for (; j + 32 <= n; j += 32)
+    {
+        __m256i here = _mm256_loadu_si256((const __m256i *) (row + j));
+        __m256i west = _mm256_loadu_si256((const __m256i *) (row + j - 1));
+        __m256i north = _mm256_loadu_si256((const __m256i *) (above + j));
+
+        __m256i bonds = _mm256_or_si256(_mm256_and_si256(here, both),
+            _mm256_or_si256(_mm256_and_si256(west, east), _mm256_and_si256(north, south)));
+        __m256i none = _mm256_cmpeq_epi8(bonds, _mm256_setzero_si256());
+
+        _mm256_storeu_si256((__m256i *) (row + j), _mm256_or_si256(here, _mm256_andnot_si256(none, occupied)));
     }
-    for (int i = 0; i < l.n; ++i)
+
+    return j;
+}
+#endif
+
+/**
+ * sets `bit' on each site of a row whose random number is below the threshold
+ */
+void mask_row(site *row, const uint32_t *r, int n, uint64_t threshold, site bit)
+{
+    int start = 0;
+#ifdef HAVE_AVX2
+    if (use_avx2())
+    {
+        start = mask_row_avx2(row, r, n, threshold, bit);
+    }
+#endif
+
+    for (int j = start; j < n; ++j)
     {
-        for (int j = 0; j < l.n; ++j)
+        row[j] |= r[j] < threshold ? bit : 0;
+    }
+}
+
+/**
+ * draws which sites of row i are occupied with probability p, without any bonds
+ * - r is scratch space for n random numbers
+ */
+void sites_row(site *row, int i, int n, double p, uint64_t seed, uint64_t trial, uint32_t *r)
+{
+    rng_row(seed, trial, STREAM_SITES, i, n, r);
+    memset(row, 0, n * sizeof(site));
+    mask_row(row, r, n, rng_threshold(p), OCCUPIED);
+}
+
+/**
+ * forms the E/S bonds of a row of occupied sites, given the row below it - a whole row
+ * at a time, as the OCCUPIED bit shifted up to the bond bits
+ */
+void site_bonds_row(site *row, const site *below, int n)
+{
+    int start = 0;
+#ifdef HAVE_AVX2
+    if (use_avx2())
+    {
+        start = site_bonds_row_avx2(row, below, n);
+    }
+#endif
+
+    for (int j = start; j < n; ++j)
+    {
+        //only E/S bonds are stored, N/W bonds belong to the neighbours
+        int east = j + 1 < n ? j + 1 : 0;
+        row[j] |= (row[j] & row[east] & OCCUPIED) << 1;
+        row[j] |= (row[j] & below[j] & OCCUPIED) << 2;
+    }
+}
+
+/**
+ * draws the E/S bonds of row i with probability p, without filling any sites
+ * - r is scratch space for n random numbers
+ */
+void bonds_row(site *row, int i, int n, double p, uint64_t seed, uint64_t trial, uint32_t *r)
+{
+    uint64_t threshold = rng_threshold(p);
+
+    memset(row, 0, n * sizeof(site));
+
+    rng_row(seed, trial, STREAM_BONDS_EAST, i, n, r);
+    mask_row(row, r, n, threshold, BOND_EAST);
+
+    rng_row(seed, trial, STREAM_BONDS_SOUTH, i, n, r);
+    mask_row(row, r, n, threshold, BOND_SOUTH);
+}
+
+/**
+ * fills the sites of a row which any bond leads to, given the row above it
+ */
+void bond_sites_row(site *row, const site *above, int n)
+{
+    //the first site's W neighbour wraps around to the end of the row
+    if ((row[0] & (BOND_EAST | BOND_SOUTH)) || (row[n - 1] & BOND_EAST) || (above[0] & BOND_SOUTH))
+    {
+        row[0] |= OCCUPIED;
+    }
+
+    int start = 1;
+#ifdef HAVE_AVX2
+    if (use_avx2())
+    {
+        start = bond_sites_row_avx2(row, above, n);
+    }
+#endif
+
+    for (int j = start; j < n; ++j)
+    {
+        if ((row[j] & (BOND_EAST | BOND_SOUTH)) || (row[j - 1] & BOND_EAST) || (above[j] & BOND_SOUTH))
         {
-            if (l.sites[i][j].occupied)
+            row[j] |= OCCUPIED;
+        }
+    }
+}
+
+/**
+ * seeds the sites of a lattice with probability p, and forms bonds appropriately
+ *
+ * the random numbers come from a counter-based generator keyed by `seed`, so the
+ * lattice only depends on the seed, not on the order the rows are filled in
+ */
+void seed_sites(lattice l, double p, uint64_t seed, uint64_t trial)
+{
+    #pragma omp parallel
+    {
+        uint32_t *r = malloc(l.n * sizeof(uint32_t));
+        site *below = malloc(l.n * sizeof(site));
+        if (r == NULL || below == NULL)
+        {
+            printf("failed to alloc\n");
+            exit(EXIT_FAILURE);
+        }
+
+        //the bonds of a row need the sites of the row below, so a row is finished once this thread
+        //has drawn the next one - the last row of each run of rows is finished from a copy of the row
+        //below drawn again, as the thread which has that row may be forming its bonds at the same time
+        int last = -1;
+        #pragma omp for schedule(static)
+        for (int i = 0; i < l.n; ++i)
+        {
+            if (last >= 0 && last != i - 1)
+            {
+                sites_row(below, WRAP(last + 1, l.n), l.n, p, seed, trial, r);
+                site_bonds_row(get_site(l, last, 0), below, l.n);
+            }
+
+            sites_row(get_site(l, i, 0), i, l.n, p, seed, trial, r);
+            if (last >= 0 && last == i - 1)
             {
-                for (int k = 0; k < N_DIRECTIONS; ++k)
-                {
-                    l.sites[i][j].bond[k] = neighbour(l, get_site(l, i, j), k)->occupied;
-                }
+                site_bonds_row(get_site(l, last, 0), get_site(l, i, 0), l.n);
             }
+            last = i;
+        }
+
+        if (last >= 0)
+        {
+            sites_row(below, WRAP(last + 1, l.n), l.n, p, seed, trial, r);
+            site_bonds_row(get_site(l, last, 0), below, l.n);
         }
+        free(below);
+        free(r);
     }
 }
 
 /**
  * seeds the bonds of a lattice with probability p, and fills the sites appropriately
+ *
+ * as with the sites, the bonds only depend on `seed`
  */
-void seed_bonds(lattice l, double p)
+void seed_bonds(lattice l, double p, uint64_t seed, uint64_t trial)
 {
-    for (int i = 0; i < l.n; ++i)
+    #pragma omp parallel
     {
-        for (int j = 0; j < l.n; ++j)
+        uint32_t *r = malloc(l.n * sizeof(uint32_t));
+        site *above = malloc(l.n * sizeof(site));
+        if (r == NULL || above == NULL)
         {
-            for (int k = 0; k < 2; ++k)
+            printf("failed to alloc\n");
+            exit(EXIT_FAILURE);
+        }
+
+        //a site is filled if any bond leads to it, including the S bonds of the row above - the first
+        //row of each run of rows reads those from a copy drawn again, as the thread which has the row
+        //above may be filling its sites at the same time
+        int last = -1;
+        #pragma omp for schedule(static)
+        for (int i = 0; i < l.n; ++i)
+        {
+            site *row = get_site(l, i, 0);
+            bonds_row(row, i, l.n, p, seed, trial, r);
+
+            if (last >= 0 && last == i - 1)
             {
-                double curr = (double) rand() / RAND_MAX;
-                if (curr < p)
-                {
-                    l.sites[i][j].bond[k] = true;
-                    l.sites[i][j].occupied = true;
-                    site *n = neighbour(l, get_site(l, i, j), k);
-                    n->occupied = true;
-                    n->bond[reverse(k)] = true;
-                }
+                bond_sites_row(row, get_site(l, last, 0), l.n);
             }
+            else
+            {
+                bonds_row(above, WRAP(i - 1, l.n), l.n, p, seed, trial, r);
+                bond_sites_row(row, above, l.n);
+            }
+            last = i;
         }
+        free(above);
+        free(r);
     }
 }
 
@@ -185,8 +506,71 @@ void print_lattice(lattice l)
   {
     for (int j = 0; j < l.n; ++j)
     {
-        printf("%2d ", get_site(l, i, j)->occupied);
+        printf("%2d ", *get_site(l, i, j) & OCCUPIED);
     }
     printf("\n");
   }
 }
+
+/**
+ * writes a lattice to a file, with a header recording how it was generated
+ */
+void save_lattice(lattice l, const char *path, char model, double p, uint64_t seed)
+{
+    lattice_header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, LATTICE_MAGIC, sizeof(h.magic));
+    h.version = LATTICE_VERSION;
+    h.n = l.n;
+    h.p = p;
+    h.seed = seed;
+    h.model = model;
+
+    FILE *f = fopen(path, "wb");
+    if (f == NULL
+        || fwrite(&h, sizeof(h), 1, f) != 1
+        || fwrite(l.sites, sizeof(site), (size_t) l.n * l.n, f) != (size_t) l.n * l.n
+        || fclose(f) != 0)
+    {
+        printf("failed to write lattice to %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * maps a lattice file written by save_lattice read-only into memory, so the sites are used
+ * straight from the file without a copy - the header is copied into h
+ */
+lattice load_lattice(const char *path, lattice_header *h)
+{
+    lattice l;
+
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(lattice_header))
+    {
+        printf("failed to read lattice from %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    l.mapped = st.st_size;
+    void *data = mmap(NULL, l.mapped, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        printf("failed to read lattice from %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    memcpy(h, data, sizeof(lattice_header));
+    if (memcmp(h->magic, LATTICE_MAGIC, sizeof(h->magic)) != 0 || h->version != LATTICE_VERSION
+        || h->n < 2 || h->geometry != 0 || l.mapped != sizeof(lattice_header) + (size_t) h->n * h->n)
+    {
+        printf("%s is not a lattice file\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    l.n = h->n;
+    l.sites = (site *) data + sizeof(lattice_header);
+    return l;
+}
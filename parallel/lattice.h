@@ -4,7 +4,9 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
 #include "util.h"
+#include "rng.h"
 
 #define N_DIRECTIONS  4
 #define NORTH         0
@@ -12,44 +14,77 @@
 #define SOUTH         2
 #define WEST          3
 
+//bits of a packed site - N/W bonds are the S/E bonds of the N/W neighbours
+#define OCCUPIED      0x1
+#define BOND_EAST     0x2
+#define BOND_SOUTH    0x4
+#define BOND_DOWN     0x8 //to the next layer of a cubic lattice
+
+#define LATTICE_MAGIC   "PERCLAT"
+#define LATTICE_VERSION 1
+
 #define BOX_WIDTH(b) ((b).ju - (b).jl + 1)
 #define BOX_HEIGHT(b) ((b).iu - (b).il + 1)
 
-//info on each lattice site
+//sums over the sites of a cluster, from which its radius of gyration follows
+#define MOMENT_I      0 //of i
+#define MOMENT_J      1 //of j
+#define MOMENT_II     2 //of i^2
+#define MOMENT_JJ     3 //of j^2
+#define N_MOMENTS     4
+
+//info on each lattice site, packed into one byte (see OCCUPIED, BOND_*)
+typedef unsigned char site;
+
+//coordinates of a site in the lattice
 typedef struct
 {
-    int i, j; //coordinates in lattice
-    bool occupied; //whether site is open or not
-    bool bond[N_DIRECTIONS]; //whether it has a bond to N E S W neighbours
-    struct _cluster *cluster; //what cluster it belongs to
-    bool on_stack; //make dfs more space efficient by only adding to stack once
-} site;
-
-//info on groups of sites connected by bonds 
+    int i, j;
+} coord;
+
+//info on groups of sites connected by bonds
 typedef struct _cluster
 {
 	int id; //unique global id
 
-	int size; //number of sites
+	int64_t size; //number of sites
 	bool global; //whether it leaves the bounding box of this region under consideration
+	bool wraps; //whether it joins up with itself around the lattice, so winds round it
 
-	site **border_sites; //the sites that have bonds leading out the north boundary
-	int n_border_sites;
+	uint64_t *rows; //bitset of the rows 0 through n - 1 it reaches
+	uint64_t *cols; //bitset of the cols 0 through n - 1 it reaches
 
-	bool *rows; //whether it spans rows 0 through n - 1
-	bool *cols; //whether it spans cols 0 through n - 1
+	//sums over its sites, in coordinates which carry on past the edges of the lattice rather than
+	//wrapping around - only kept if the clusters are observed, see observables.h
+	double moments[N_MOMENTS];
 
 	struct _cluster *redirect; //may redirect to a `canonical' cluster once merged
+	int di, dj; //added onto the coordinates of this cluster to get those of the redirect one
 } cluster;
 
 //a square lattice holding sites
 typedef struct
 {
-    site **sites; //a 2d square array of sites
+    site *sites; //a 2d square array of sites, stored row by row
     int n; //dimensions
+    size_t mapped; //bytes mapped in from a lattice file, or 0 if the sites were allocated
 } lattice;
 
-typedef struct 
+//start of a lattice file, which is followed by the n * n sites row by row, one byte each as in memory
+//- fields are in the byte order of the machine which wrote it
+typedef struct
+{
+    char magic[8]; //LATTICE_MAGIC
+    uint32_t version; //LATTICE_VERSION
+    uint32_t n; //dimensions
+    double p; //seeding probability
+    uint64_t seed; //seed the lattice was generated from
+    char model; //'s' or 'b' for site/bond seeding
+    char geometry; //0 for a square lattice, which is the only one solved here
+    char unused[6];
+} lattice_header;
+
+typedef struct
 {
     int il, iu; //lower and upper i
     int jl, ju; //lower and upper j
@@ -58,11 +93,21 @@ typedef struct
 lattice create_lattice(int n);
 site *get_site(lattice l, int i, int j);
 void delete_lattice(lattice l);
-site *neighbour(lattice l, site *s, int dir);
-void seed_sites(lattice l, double p);
-void seed_bonds(lattice l, double p);
+coord neighbour(lattice l, coord c, int dir);
+bool bond(lattice l, coord c, int dir);
+void set_bond(lattice l, coord c, int dir, bool on);
+void mask_row(site *row, const uint32_t *r, int n, uint64_t threshold, site bit);
+void sites_row(site *row, int i, int n, double p, uint64_t seed, uint64_t trial, uint32_t *r);
+void site_bonds_row(site *row, const site *below, int n);
+void bonds_row(site *row, int i, int n, double p, uint64_t seed, uint64_t trial, uint32_t *r);
+void bond_sites_row(site *row, const site *above, int n);
+void seed_sites(lattice l, double p, uint64_t seed, uint64_t trial);
+void seed_bonds(lattice l, double p, uint64_t seed, uint64_t trial);
 void print_lattice(lattice l);
+void save_lattice(lattice l, const char *path, char model, double p, uint64_t seed);
+lattice load_lattice(const char *path, lattice_header *h);
 cluster *canonical(cluster *c);
-void merge_clusters(lattice l, cluster *a, cluster *b);
+void add_moments(double *into, const double *from, int64_t size, int di, int dj);
+void merge_clusters(lattice l, cluster *a, cluster *b, int di, int dj);
 
 #endif
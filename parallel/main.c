@@ -1,73 +1,471 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
 #include <time.h>
 #include <omp.h>
 #include <string.h>
 #include "percolation.h"
 #include "lattice.h"
+#include "sweep.h"
+#include "batch.h"
+#include "cubic.h"
+#include "decide.h"
 
 /**
  * user has entered wrong program args - print help message and exit
  */
 void exit_incorrect_args()
 {
-    printf("usage: ./main lattice_size seed_prob seed_what percolation_kind [num_threads]\n");
+    printf("usage: ./main [options] lattice_size seed_prob seed_what percolation_kind [num_threads]\n");
+    printf("   or: ./main [options] --batch file [num_threads]\n");
+    printf("   or: ./main [options] --load file percolation_kind [num_threads]\n");
     printf("\twhere seed_what=s/b for site/bond seeding, percolation_kind=0/1/2 for row/col/both percolation checking\n");
+    printf("options:\n");
+    printf("\t--engine dfs/uf/lp\tlabel clusters by depth first search (default), union-find, or by propagating the\n");
+    printf("\t\tleast label along bonds with vectorised sweeps, falling back to union-find for boxes slow to settle\n");
+    printf("\t--tile rowsxcols\tlabel boxes of at most rows x cols sites in parallel (default: 2 bands of rows per\n");
+    printf("\t\tthread, split into 4 boxes across) - threads start on their own boxes, then steal the rest\n");
+    printf("\t--merge tree/serial/concurrent\tjoin boxes pairwise in parallel (default), one at a time,\n");
+    printf("\t\tor from every thread as soon as neighbouring boxes are labelled\n");
+    printf("\t--sweep points\tinstead of one lattice at seed_prob, add sites/bonds one at a time (Newman-Ziff) and print\n");
+    printf("\t\tpercolation and max cluster at `points' + 1 occupied fractions and values of p from 0 to 1, as csv\n");
+    printf("\t\t(lattices of at most 46340x46340)\n");
+    printf("\t--batch file\trun trials of each `lattice_size seed_prob seed_what percolation_kind' line of the file,\n");
+    printf("\t\tand print the mean, variance and 95%% confidence interval of percolation and max cluster\n");
+    printf("\t--trials trials\tnumber of lattices for each line of the batch file (default: 100)\n");
+    printf("\t--format csv/json\toutput format of a batch (default: csv)\n");
+    printf("\t--save file\twrite the seeded lattice to a binary lattice file\n");
+    printf("\t--load file\tmap a lattice file written by --save instead of seeding one, which gives its size and seeding\n");
+    printf("\t--seed seed\tseed for the random lattice, the same seed always gives the same lattice (default: time)\n");
+    printf("\t--dim 2/3\tsolve a square (default) or simple cubic lattice, which is split into one slab of layers\n");
+    printf("\t\tper thread and labelled with union-find - percolation_kind=0/1/2/3 checks spanning along x/y/z/all\n");
+    printf("\t--decide\tonly decide whether it percolates, searching out from the first row/col on every thread and\n");
+    printf("\t\tstopping as soon as a cluster is found to span, without labelling every cluster or finding the max cluster\n");
+    printf("\t--profile\tafter the result, print a line of json with the time and hardware counters of each phase,\n");
+    printf("\t\tthe time each thread spent labelling, and what happened in each box\n");
+    printf("\t--bind close/spread\tpin thread k to the k-th core, or space the threads out evenly over the cores\n");
+    printf("\t\t(so over every NUMA node), before the lattice is allocated - with --profile, each box reports\n");
+    printf("\t\tthe node holding its sites and the node of the core which labelled it\n");
+    printf("\t--histogram file\twhile labelling, also bin the clusters by size and write out the number of clusters per\n");
+    printf("\t\tsite n_s and mean radius of gyration of each bin, and the mean cluster size, as csv (merges as a tree)\n");
     printf("minimum lattice size is 2x2\n");
     exit(EXIT_FAILURE);
 }
 
+/**
+ * sets the number of threads to use, pinning them to cores if asked
+ */
+void set_threads(int threads, binding b)
+{
+    omp_set_num_threads(threads);
+    if (!bind_threads(b))
+    {
+        printf("failed to bind threads\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * runs a Newman-Ziff sweep over all occupations of the lattice and prints csv with, for each
+ * x = 0, 1 / points, ..., 1, the result once a fraction x of the sites/bonds are occupied, and the
+ * chance of percolating and mean max cluster when each is occupied with probability x
+ */
+void print_sweep(int n, bool bonds, bool rows, bool cols, uint64_t seed, int points)
+{
+    sweep s = bonds ? sweep_bonds(n, rows, cols, seed) : sweep_sites(n, rows, cols, seed);
+
+    printf("x,percolates_at_fraction,max_cluster_at_fraction,percolation_probability,mean_max_cluster\n");
+    for (int k = 0; k <= points; ++k)
+    {
+        double x = (double) k / points;
+        int64_t occupied = k * s.m / points;
+
+        double percolates, max_cluster;
+        sweep_at(s, x, &percolates, &max_cluster);
+
+        printf("%.6f,%d,%" PRId64 ",%.6f,%.2f\n", x, s.percolates[occupied], s.max_cluster[occupied], percolates, max_cluster);
+    }
+
+    sweep_free(s);
+}
+
+/**
+ * seeds and solves an n by n by n lattice, printing whether it percolates along the axes given by
+ * percolation_kind, the max cluster and which axes any cluster spans
+ */
+void print_cubic(int n, double p, bool bonds, int percolation_kind, uint64_t seed)
+{
+    bool check[N_AXES];
+    for (int axis = 0; axis < N_AXES; ++axis)
+    {
+        check[axis] = percolation_kind == axis || percolation_kind == N_AXES;
+    }
+
+    double time = omp_get_wtime();
+    cubic l = create_cubic(n);
+    if (bonds)
+    {
+        seed_cubic_bonds(l, p, seed);
+    }
+    else
+    {
+        seed_cubic_sites(l, p, seed);
+    }
+    double seed_time = omp_get_wtime() - time;
+
+    time = omp_get_wtime();
+    int64_t max_cluster;
+    bool spans[N_AXES];
+    bool success = percolation_cubic(l, check, &max_cluster, spans);
+
+    printf("percolates=%s,max_cluster=%" PRId64 ",spans_x=%s,spans_y=%s,spans_z=%s,seed=%" PRIu64 ",seed_time=%.4fs,time=%.4fs\n",
+        success ? "true" : "false", max_cluster, spans[AXIS_X] ? "true" : "false", spans[AXIS_Y] ? "true" : "false",
+        spans[AXIS_Z] ? "true" : "false", seed, seed_time, omp_get_wtime() - time);
+
+    delete_cubic(l);
+}
+
 /**
  * main function - prints if a lattice percolates, + max cluster, time taken
  */
 int main(int argc, char *argv[])
 {
-    srand(time(NULL));
-
     --argc;
     ++argv;
 
-    if (argc < 4)
+    options o = {ENGINE_DFS, MERGE_TREE, 0, 0};
+    uint64_t seed = time(NULL);
+    int sweep_points = 0;
+    char *batch_file = NULL;
+    int trials = 100;
+    format batch_format = FORMAT_CSV;
+    char *save_file = NULL;
+    char *load_file = NULL;
+    bool profiling = false;
+    bool decide = false;
+    char *histogram_file = NULL;
+    binding bind = BIND_NONE;
+    int dim = 2;
+
+    //pull out `--name value' options, leaving the positional args in order
+    int n_args = 0;
+    for (int k = 0; k < argc; ++k)
     {
-        exit_incorrect_args();
-    }
+        if (strncmp(argv[k], "--", 2) != 0)
+        {
+            argv[n_args++] = argv[k];
+            continue;
+        }
 
-    int n = atoi(argv[0]);
-    double p = atof(argv[1]);
-    char *seed_type = argv[2];
-    int percolation_type = atoi(argv[3]);
-    int num_threads = argc > 4 ? atoi(argv[4]) : omp_get_num_procs();
+        if (strcmp(argv[k], "--profile") == 0)
+        {
+            profiling = true;
+            continue;
+        }
 
-    if (n <= 1 || p < 0 || p > 1 || percolation_type < 0 || percolation_type > 2)
-    {
-        exit_incorrect_args();
+        if (strcmp(argv[k], "--decide") == 0)
+        {
+            decide = true;
+            continue;
+        }
+
+        if (k + 1 == argc)
+        {
+            exit_incorrect_args();
+        }
+
+        char *name = argv[k] + 2;
+        char *value = argv[++k];
+
+        if (strcmp(name, "engine") == 0 && strcmp(value, "dfs") == 0)
+        {
+            o.engine = ENGINE_DFS;
+        }
+        else if (strcmp(name, "engine") == 0 && strcmp(value, "uf") == 0)
+        {
+            o.engine = ENGINE_UF;
+        }
+        else if (strcmp(name, "engine") == 0 && strcmp(value, "lp") == 0)
+        {
+            o.engine = ENGINE_LP;
+        }
+        else if (strcmp(name, "merge") == 0 && strcmp(value, "tree") == 0)
+        {
+            o.merge = MERGE_TREE;
+        }
+        else if (strcmp(name, "merge") == 0 && strcmp(value, "serial") == 0)
+        {
+            o.merge = MERGE_SERIAL;
+        }
+        else if (strcmp(name, "merge") == 0 && strcmp(value, "concurrent") == 0)
+        {
+            o.merge = MERGE_CONCURRENT;
+        }
+        else if (strcmp(name, "tile") == 0)
+        {
+            if (sscanf(value, "%dx%d", &o.tile_rows, &o.tile_cols) != 2 || o.tile_rows < 1 || o.tile_cols < 1)
+            {
+                exit_incorrect_args();
+            }
+        }
+        else if (strcmp(name, "sweep") == 0)
+        {
+            sweep_points = atoi(value);
+            if (sweep_points < 1)
+            {
+                exit_incorrect_args();
+            }
+        }
+        else if (strcmp(name, "batch") == 0)
+        {
+            batch_file = value;
+        }
+        else if (strcmp(name, "trials") == 0)
+        {
+            trials = atoi(value);
+            if (trials < 1)
+            {
+                exit_incorrect_args();
+            }
+        }
+        else if (strcmp(name, "format") == 0 && strcmp(value, "csv") == 0)
+        {
+            batch_format = FORMAT_CSV;
+        }
+        else if (strcmp(name, "format") == 0 && strcmp(value, "json") == 0)
+        {
+            batch_format = FORMAT_JSON;
+        }
+        else if (strcmp(name, "save") == 0)
+        {
+            save_file = value;
+        }
+        else if (strcmp(name, "load") == 0)
+        {
+            load_file = value;
+        }
+        else if (strcmp(name, "bind") == 0 && strcmp(value, "close") == 0)
+        {
+            bind = BIND_CLOSE;
+        }
+        else if (strcmp(name, "bind") == 0 && strcmp(value, "spread") == 0)
+        {
+            bind = BIND_SPREAD;
+        }
+        else if (strcmp(name, "histogram") == 0)
+        {
+            histogram_file = value;
+        }
+        else if (strcmp(name, "dim") == 0 && (strcmp(value, "2") == 0 || strcmp(value, "3") == 0))
+        {
+            dim = atoi(value);
+        }
+        else if (strcmp(name, "seed") == 0)
+        {
+            seed = strtoull(value, NULL, 10);
+        }
+        else
+        {
+            exit_incorrect_args();
+        }
     }
+    argc = n_args;
+
+    //cubic lattices are only solved one at a time, straight after seeding
+    if (dim == 3)
+    {
+        if (argc < 4 || batch_file != NULL || sweep_points > 0 || save_file != NULL || load_file != NULL || profiling
+            || histogram_file != NULL || decide)
+        {
+            exit_incorrect_args();
+        }
 
-    omp_set_num_threads(num_threads);
+        int n = atoi(argv[0]);
+        double p = atof(argv[1]);
+        int percolation_type = atoi(argv[3]);
+        if (n <= 1 || p < 0 || p > 1 || percolation_type < 0 || percolation_type > N_AXES
+            || (strcmp(argv[2], "s") != 0 && strcmp(argv[2], "b") != 0))
+        {
+            exit_incorrect_args();
+        }
 
-    lattice l = create_lattice(n);
+        set_threads(argc > 4 ? atoi(argv[4]) : omp_get_num_procs(), bind);
+        print_cubic(n, p, strcmp(argv[2], "b") == 0, percolation_type, seed);
+        return EXIT_SUCCESS;
+    }
 
-    if (strcmp(seed_type, "s") == 0)
+    //a batch reads its lattices from the file, so only takes the number of threads
+    if (batch_file != NULL)
     {
-        seed_sites(l, p);
+        if (argc > 1 || sweep_points > 0 || save_file != NULL || load_file != NULL || profiling || histogram_file != NULL
+            || decide)
+        {
+            exit_incorrect_args();
+        }
+
+        FILE *f = fopen(batch_file, "r");
+        if (f == NULL)
+        {
+            printf("failed to open %s\n", batch_file);
+            exit(EXIT_FAILURE);
+        }
+
+        config *configs;
+        int n_configs = read_configs(f, &configs);
+        fclose(f);
+
+        set_threads(argc > 0 ? atoi(argv[0]) : omp_get_num_procs(), bind);
+        run_batch(configs, n_configs, trials, o, seed, batch_format);
+
+        free(configs);
+        return EXIT_SUCCESS;
     }
-    else if (strcmp(seed_type, "b") == 0)
+
+    lattice l;
+    int n, percolation_type, num_threads;
+    double p;
+    char *seed_type;
+    char model[2] = "";
+
+    if (load_file != NULL)
     {
-        seed_bonds(l, p);
+        //a loaded lattice brings its own size, seeding and seed with it
+        if (argc < 1 || sweep_points > 0)
+        {
+            exit_incorrect_args();
+        }
+
+        lattice_header h;
+        l = load_lattice(load_file, &h);
+        n = l.n;
+        p = h.p;
+        model[0] = h.model;
+        seed_type = model;
+        seed = h.seed;
+        percolation_type = atoi(argv[0]);
+        num_threads = argc > 1 ? atoi(argv[1]) : omp_get_num_procs();
     }
     else
+    {
+        if (argc < 4)
+        {
+            exit_incorrect_args();
+        }
+
+        n = atoi(argv[0]);
+        p = atof(argv[1]);
+        seed_type = argv[2];
+        percolation_type = atoi(argv[3]);
+        num_threads = argc > 4 ? atoi(argv[4]) : omp_get_num_procs();
+    }
+
+    if (n <= 1 || p < 0 || p > 1 || percolation_type < 0 || percolation_type > 2)
     {
         exit_incorrect_args();
     }
 
+    set_threads(num_threads, bind);
+
     bool row_check = percolation_type == 0 || percolation_type == 2;
     bool col_check = percolation_type == 1 || percolation_type == 2;
 
-    int max_cluster;
+    if (strcmp(seed_type, "s") != 0 && strcmp(seed_type, "b") != 0)
+    {
+        exit_incorrect_args();
+    }
+
+    if ((sweep_points > 0 || decide) && (profiling || histogram_file != NULL || (sweep_points > 0 && decide)))
+    {
+        exit_incorrect_args();
+    }
+
+    if (sweep_points > 0)
+    {
+        if (n > SWEEP_MAX_SIZE)
+        {
+            printf("a sweep can run on lattices of at most %dx%d\n", SWEEP_MAX_SIZE, SWEEP_MAX_SIZE);
+            exit(EXIT_FAILURE);
+        }
+        print_sweep(n, strcmp(seed_type, "b") == 0, row_check, col_check, seed, sweep_points);
+        return EXIT_SUCCESS;
+    }
+
+    //counters are opened on every thread before any of the work they count - a loaded lattice
+    //was mapped already, so has no allocation or seeding
+    profile prof;
+    if (profiling)
+    {
+        profile_init(&prof);
+        profile_start(&prof);
+    }
+
+    if (load_file == NULL)
+    {
+        l = create_lattice(n);
+
+        if (profiling)
+        {
+            profile_stop(&prof, PHASE_ALLOC);
+            profile_start(&prof);
+        }
+
+        if (strcmp(seed_type, "s") == 0)
+        {
+            seed_sites(l, p, seed, 0);
+        }
+        else
+        {
+            seed_bonds(l, p, seed, 0);
+        }
+
+        if (profiling)
+        {
+            profile_stop(&prof, PHASE_SEED);
+        }
+    }
+
+    if (save_file != NULL)
+    {
+        save_lattice(l, save_file, seed_type[0], p, seed);
+    }
+
+    if (decide)
+    {
+        double time = omp_get_wtime();
+        bool success = percolation_decide(l, row_check, col_check);
+
+        printf("percolates=%s,seed=%" PRIu64 ",time=%.4fs\n", success ? "true" : "false", seed, omp_get_wtime() - time);
+
+        delete_lattice(l);
+        return EXIT_SUCCESS;
+    }
+
+    int64_t max_cluster;
+    timings t;
+    t.detail = profiling ? &prof : NULL;
+
+    histogram h;
+    if (histogram_file != NULL)
+    {
+        histogram_init(&h);
+        o.observables = &h;
+    }
 
     double time = omp_get_wtime();
-    bool success = percolation(l, row_check, col_check, &max_cluster);
+    bool success = percolation(l, row_check, col_check, o, &max_cluster, &t, NULL);
 
-    printf("percolates=%s,max_cluster=%d,time=%.4fs\n", success ? "true" : "false", max_cluster, omp_get_wtime() - time);
+    printf("percolates=%s,max_cluster=%" PRId64 ",seed=%" PRIu64 ",label_time=%.4fs,merge_time=%.4fs,time=%.4fs\n", success ? "true" : "false", max_cluster, seed, t.label, t.merge, omp_get_wtime() - time);
+
+    if (profiling)
+    {
+        profile_print(&prof);
+        profile_free(&prof);
+    }
+
+    if (histogram_file != NULL)
+    {
+        histogram_write(&h, n, p, histogram_file);
+    }
 
     //print_lattice(l);
 
@@ -0,0 +1,462 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <string.h>
+#include <time.h>
+#include <mpi.h>
+#include "lattice.h"
+#include "percolation.h"
+#include "unionfind.h"
+
+//what is sent to rank 0 for each cluster leaving a band through its N or S edge
+#define SUMMARY_SIZE        0
+#define SUMMARY_ROW_START   1
+#define SUMMARY_ROW_LEN     2
+#define SUMMARY_COL_START   3
+#define SUMMARY_COL_LEN     4
+#define SUMMARY_FIELDS      5
+
+//a bond across the seam above a band: id of the cluster above, id of the one below, row above the seam, col
+#define PAIR_UPPER          0
+#define PAIR_LOWER          1
+#define PAIR_ROW            2
+#define PAIR_COL            3
+#define PAIR_FIELDS         4
+
+/**
+ * user has entered wrong program args - print help message from the first rank and exit
+ */
+void exit_incorrect_args(int rank)
+{
+    if (rank == 0)
+    {
+        printf("usage: mpirun -np ranks mpi/main [options] lattice_size seed_prob seed_what percolation_kind\n");
+        printf("\twhere seed_what=s/b for site/bond seeding, percolation_kind=0/1/2 for row/col/both percolation checking\n");
+        printf("\teach rank seeds and labels its own band of rows, so holds about lattice_size / ranks of them\n");
+        printf("options:\n");
+        printf("\t--engine dfs/uf/lp\tlabel each band by depth first search (default), union-find or label propagation\n");
+        printf("\t--seed seed\tseed for the random lattice, which is the same lattice as ./main gives (default: time)\n");
+        printf("lattice_size must be at least 2, and at least the number of ranks\n");
+    }
+    MPI_Finalize();
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * sends a row of n sites to rank `to`, while receiving one from rank `from`
+ */
+void halo_row(const site *send, int to, site *recv, int from, int n)
+{
+    MPI_Sendrecv(send, n, MPI_UNSIGNED_CHAR, to, 0, recv, n, MPI_UNSIGNED_CHAR, from, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+}
+
+/**
+ * seeds rows 1 to h of l with the band of h rows starting at row r0 of the whole lattice, and
+ * row 0 with the bonds of the row above it - rows only depend on the seed, so each rank seeds
+ * its own, and only swaps the rows on the edges of its band with the ranks above and below
+ */
+void seed_band(lattice l, int h, int r0, int up, int down, bool bonds, double p, uint64_t seed)
+{
+    int n = l.n;
+    uint32_t *r = malloc(n * sizeof(uint32_t));
+    site *below = malloc(n * sizeof(site));
+    if (r == NULL || below == NULL)
+    {
+        printf("failed to alloc\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (bonds)
+    {
+        for (int k = 1; k <= h; ++k)
+        {
+            bonds_row(get_site(l, k, 0), r0 + k - 1, n, p, seed, 0, r);
+        }
+
+        //bonds leading S out of the band above fill the first row of this one
+        halo_row(get_site(l, h, 0), down, get_site(l, 0, 0), up, n);
+        for (int k = 1; k <= h; ++k)
+        {
+            bond_sites_row(get_site(l, k, 0), get_site(l, k - 1, 0), n);
+        }
+    }
+    else
+    {
+        for (int k = 1; k <= h; ++k)
+        {
+            sites_row(get_site(l, k, 0), r0 + k - 1, n, p, seed, 0, r);
+        }
+
+        //the last row bonds S to the first row of the band below
+        halo_row(get_site(l, 1, 0), up, below, down, n);
+        for (int k = 1; k <= h; ++k)
+        {
+            site_bonds_row(get_site(l, k, 0), k < h ? get_site(l, k + 1, 0) : below, n);
+        }
+
+        //the bonds leading N out of this band are the S bonds of the last row of the one above
+        halo_row(get_site(l, h, 0), down, get_site(l, 0, 0), up, n);
+    }
+
+    free(below);
+    free(r);
+}
+
+/**
+ * distributed memory solver - each MPI rank seeds and labels a band of rows of the lattice, and
+ * the clusters leaving each band are joined up on rank 0, which prints if the lattice percolates,
+ * + max cluster, time taken
+ */
+int main(int argc, char *argv[])
+{
+    MPI_Init(&argc, &argv);
+
+    int rank, ranks;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &ranks);
+
+    --argc;
+    ++argv;
+
+    engine e = ENGINE_DFS;
+    uint64_t seed = time(NULL);
+
+    //pull out `--name value' options, leaving the positional args in order
+    int n_args = 0;
+    for (int k = 0; k < argc; ++k)
+    {
+        if (strncmp(argv[k], "--", 2) != 0)
+        {
+            argv[n_args++] = argv[k];
+            continue;
+        }
+
+        if (k + 1 == argc)
+        {
+            exit_incorrect_args(rank);
+        }
+
+        char *name = argv[k] + 2;
+        char *value = argv[++k];
+
+        if (strcmp(name, "engine") == 0 && strcmp(value, "dfs") == 0)
+        {
+            e = ENGINE_DFS;
+        }
+        else if (strcmp(name, "engine") == 0 && strcmp(value, "uf") == 0)
+        {
+            e = ENGINE_UF;
+        }
+        else if (strcmp(name, "engine") == 0 && strcmp(value, "lp") == 0)
+        {
+            e = ENGINE_LP;
+        }
+        else if (strcmp(name, "seed") == 0)
+        {
+            seed = strtoull(value, NULL, 10);
+        }
+        else
+        {
+            exit_incorrect_args(rank);
+        }
+    }
+    argc = n_args;
+
+    if (argc < 4)
+    {
+        exit_incorrect_args(rank);
+    }
+
+    int n = atoi(argv[0]);
+    double p = atof(argv[1]);
+    char *seed_type = argv[2];
+    int percolation_type = atoi(argv[3]);
+
+    if (n <= 1 || n < ranks || p < 0 || p > 1 || percolation_type < 0 || percolation_type > 2
+        || (strcmp(seed_type, "s") != 0 && strcmp(seed_type, "b") != 0))
+    {
+        exit_incorrect_args(rank);
+    }
+
+    bool row_check = percolation_type == 0 || percolation_type == 2;
+    bool col_check = percolation_type == 1 || percolation_type == 2;
+
+    //every rank has to seed the same lattice
+    MPI_Bcast(&seed, 1, MPI_UINT64_T, 0, MPI_COMM_WORLD);
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    double time = MPI_Wtime();
+
+    //this rank's band of rows, and the ranks holding the bands above and below, wrapping around
+    int r0 = tile_start(n, ranks, rank);
+    int h = tile_start(n, ranks, rank + 1) - r0;
+    int up = (rank + ranks - 1) % ranks;
+    int down = (rank + 1) % ranks;
+
+    //the band is held as rows 1 to h, below the row above it, so that row i of l is row r0 - 1 + i of
+    //the whole lattice - a single rank holds the whole lattice as it is, which wraps around already
+    int first = ranks > 1 ? 1 : 0;
+    lattice l;
+    if (ranks > 1)
+    {
+        l.n = n;
+        l.mapped = 0;
+        l.sites = calloc((size_t) (h + 1) * n, sizeof(site));
+        if (l.sites == NULL)
+        {
+            printf("failed to alloc\n");
+            exit(EXIT_FAILURE);
+        }
+        seed_band(l, h, r0, up, down, strcmp(seed_type, "b") == 0, p, seed);
+    }
+    else
+    {
+        l = create_lattice(n);
+        if (strcmp(seed_type, "b") == 0)
+        {
+            seed_bonds(l, p, seed, 0);
+        }
+        else
+        {
+            seed_sites(l, p, seed, 0);
+        }
+    }
+
+    //label the band as one box, with its clusters joined up around the E/W edge
+    region r;
+    memset(&r, 0, sizeof(region));
+    r.b.il = first;
+    r.b.iu = first + h - 1;
+    r.b.jl = 0;
+    r.b.ju = n - 1;
+    r.start_label = 1;
+
+    workspace w;
+    workspace_init(&w);
+    label_band(l, e, &r, &w);
+
+    //clusters which never leave the band are done with here
+    int64_t local_max = r.max;
+    int spans[2] = {r.spans_rows, r.spans_cols};
+
+    //number each cluster leaving through the N or S edge, and label those edges with them
+    int *index = malloc(MAX(r.n_clusters, 1) * sizeof(int));
+    int *edge_label = malloc(2 * n * sizeof(int));
+    int *above = malloc(n * sizeof(int));
+    if (index == NULL || edge_label == NULL || above == NULL)
+    {
+        printf("failed to alloc\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int k = 0; k < r.n_clusters; ++k)
+    {
+        index[k] = -1;
+    }
+
+    int n_boundary = 0;
+    for (int side = 0; side < 2; ++side)
+    {
+        cluster **edge = r.edge[side == 0 ? NORTH : SOUTH];
+        for (int x = 0; x < n; ++x)
+        {
+            if (edge[x] == NULL)
+            {
+                edge_label[side * n + x] = -1;
+                continue;
+            }
+
+            int k = canonical(edge[x])->id - r.start_label;
+            if (index[k] < 0)
+            {
+                index[k] = n_boundary++;
+            }
+            edge_label[side * n + x] = index[k];
+        }
+    }
+
+    //ids are made unique over all ranks by counting those of the ranks before
+    int offset = 0;
+    MPI_Exscan(&n_boundary, &offset, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0)
+    {
+        offset = 0;
+    }
+    for (int x = 0; x < 2 * n; ++x)
+    {
+        if (edge_label[x] >= 0)
+        {
+            edge_label[x] += offset;
+        }
+    }
+
+    int64_t *summaries = malloc(MAX(n_boundary, 1) * SUMMARY_FIELDS * sizeof(int64_t));
+    if (summaries == NULL)
+    {
+        printf("failed to alloc\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int j = 0; j < r.n_clusters; ++j)
+    {
+        cluster *c = r.clusters[j];
+        if (c->redirect != NULL)
+        {
+            continue;
+        }
+
+        int k = index[c->id - r.start_label];
+        if (k < 0)
+        {
+            //only ever left the band around the E/W edge, so is whole already
+            local_max = MAX(local_max, c->size);
+            spans[0] |= bitset_full(c->rows, n);
+            spans[1] |= bitset_full(c->cols, n);
+            continue;
+        }
+
+        //the rows of a cluster joined up within the band are a run, as are its cols
+        span rows = bitset_span(c->rows, n);
+        span cols = bitset_span(c->cols, n);
+        int64_t *summary = &summaries[k * SUMMARY_FIELDS];
+        summary[SUMMARY_SIZE] = c->size;
+        summary[SUMMARY_ROW_START] = WRAP(r0 - first + rows.start, n);
+        summary[SUMMARY_ROW_LEN] = rows.len;
+        summary[SUMMARY_COL_START] = cols.start;
+        summary[SUMMARY_COL_LEN] = cols.len;
+    }
+
+    //halo of labels: the S edge of the band above meets the N edge of this one
+    MPI_Sendrecv(edge_label + n, n, MPI_INT, down, 1, above, n, MPI_INT, up, 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+
+    int n_pairs = 0;
+    int *pairs = malloc(n * PAIR_FIELDS * sizeof(int));
+    if (pairs == NULL)
+    {
+        printf("failed to alloc\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int x = 0; x < n; ++x)
+    {
+        if (above[x] >= 0 && edge_label[x] >= 0)
+        {
+            int *pair = &pairs[n_pairs++ * PAIR_FIELDS];
+            pair[PAIR_UPPER] = above[x];
+            pair[PAIR_LOWER] = edge_label[x];
+            pair[PAIR_ROW] = WRAP(r0 - 1, n);
+            pair[PAIR_COL] = x;
+        }
+    }
+
+    //gather the clusters on the band edges and the bonds between them on rank 0, to merge there
+    int counts[2] = {n_boundary * SUMMARY_FIELDS, n_pairs * PAIR_FIELDS};
+    int *all_counts = NULL;
+    int *summary_counts = NULL, *summary_displs = NULL;
+    int *pair_counts = NULL, *pair_displs = NULL;
+    int64_t *all_summaries = NULL;
+    int *all_pairs = NULL;
+    int totals[2] = {0, 0};
+
+    if (rank == 0)
+    {
+        all_counts = malloc(6 * ranks * sizeof(int));
+        if (all_counts == NULL)
+        {
+            printf("failed to alloc\n");
+            exit(EXIT_FAILURE);
+        }
+        summary_counts = all_counts + 2 * ranks;
+        summary_displs = all_counts + 3 * ranks;
+        pair_counts = all_counts + 4 * ranks;
+        pair_displs = all_counts + 5 * ranks;
+    }
+    MPI_Gather(counts, 2, MPI_INT, all_counts, 2, MPI_INT, 0, MPI_COMM_WORLD);
+
+    if (rank == 0)
+    {
+        for (int k = 0; k < ranks; ++k)
+        {
+            summary_counts[k] = all_counts[2 * k];
+            pair_counts[k] = all_counts[2 * k + 1];
+            summary_displs[k] = totals[0];
+            pair_displs[k] = totals[1];
+            totals[0] += summary_counts[k];
+            totals[1] += pair_counts[k];
+        }
+
+        all_summaries = malloc(MAX(totals[0], 1) * sizeof(int64_t));
+        all_pairs = malloc(MAX(totals[1], 1) * sizeof(int));
+        if (all_summaries == NULL || all_pairs == NULL)
+        {
+            printf("failed to alloc\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    MPI_Gatherv(summaries, counts[0], MPI_INT64_T, all_summaries, summary_counts, summary_displs, MPI_INT64_T, 0, MPI_COMM_WORLD);
+    MPI_Gatherv(pairs, counts[1], MPI_INT, all_pairs, pair_counts, pair_displs, MPI_INT, 0, MPI_COMM_WORLD);
+
+    //the rest of the clusters are only reduced
+    int64_t full_max = 0;
+    int full_spans[2] = {0, 0};
+    MPI_Reduce(&local_max, &full_max, 1, MPI_INT64_T, MPI_MAX, 0, MPI_COMM_WORLD);
+    MPI_Reduce(spans, full_spans, 2, MPI_INT, MPI_LOR, 0, MPI_COMM_WORLD);
+
+    if (rank == 0)
+    {
+        //label k + 1 for the cluster with id k, as label 0 is never handed out
+        int n_clusters = totals[0] / SUMMARY_FIELDS;
+        labels u;
+        labels_init(&u, n, n_clusters + 1);
+        for (int k = 0; k < n_clusters; ++k)
+        {
+            const int64_t *summary = &all_summaries[k * SUMMARY_FIELDS];
+            span rows = {(int) summary[SUMMARY_ROW_START], (int) summary[SUMMARY_ROW_LEN]};
+            span cols = {(int) summary[SUMMARY_COL_START], (int) summary[SUMMARY_COL_LEN]};
+            labels_push(&u, summary[SUMMARY_SIZE], rows, cols);
+        }
+
+        for (int k = 0; k < totals[1] / PAIR_FIELDS; ++k)
+        {
+            const int *pair = &all_pairs[k * PAIR_FIELDS];
+            coord c = {pair[PAIR_ROW], pair[PAIR_COL]};
+            labels_union(&u, pair[PAIR_UPPER] + 1, pair[PAIR_LOWER] + 1, c);
+        }
+
+        for (int a = 1; a < u.count; ++a)
+        {
+            if (u.parent[a] == a)
+            {
+                full_max = MAX(full_max, u.size[a]);
+                full_spans[0] |= u.rows[a].len == n;
+                full_spans[1] |= u.cols[a].len == n;
+            }
+        }
+        labels_free(&u);
+
+        bool success = (!row_check || full_spans[0]) && (!col_check || full_spans[1]);
+        printf("percolates=%s,max_cluster=%" PRId64 ",seed=%" PRIu64 ",ranks=%d,time=%.4fs\n", success ? "true" : "false",
+            full_max, seed, ranks, MPI_Wtime() - time);
+
+        free(all_counts);
+        free(all_summaries);
+        free(all_pairs);
+    }
+
+    free(pairs);
+    free(summaries);
+    free(above);
+    free(edge_label);
+    free(index);
+    workspace_free(&w);
+    if (ranks > 1)
+    {
+        free(l.sites);
+    }
+    else
+    {
+        delete_lattice(l);
+    }
+
+    MPI_Finalize();
+    return EXIT_SUCCESS;
+}
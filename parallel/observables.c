@@ -0,0 +1,99 @@
+#include <inttypes.h>
+#include <math.h>
+#include "observables.h"
+
+/**
+ * initialises an empty histogram
+ */
+void histogram_init(histogram *h)
+{
+    memset(h, 0, sizeof(histogram));
+}
+
+/**
+ * counts a cluster of `size` sites with the given moments (see MOMENT_*) into a histogram
+ */
+void histogram_add(histogram *h, int64_t size, const double *moments, bool spans)
+{
+    if (spans)
+    {
+        ++h->spanning;
+        h->spanning_sites += size;
+        return;
+    }
+
+    //squared distance of the sites from their centre of mass, on average
+    double s = (double) size;
+    double mean_i = moments[MOMENT_I] / s;
+    double mean_j = moments[MOMENT_J] / s;
+    double rg2 = (moments[MOMENT_II] + moments[MOMENT_JJ]) / s - mean_i * mean_i - mean_j * mean_j;
+
+    int bin = 63 - __builtin_clzll((uint64_t) size);
+    ++h->clusters[bin];
+    h->sites[bin] += s;
+    h->gyration[bin] += MAX(rg2, 0);
+
+    h->sum_size += s;
+    h->sum_size2 += s * s;
+}
+
+/**
+ * adds the clusters counted in histogram b onto a
+ */
+void histogram_merge(histogram *a, const histogram *b)
+{
+    for (int k = 0; k < HISTOGRAM_BINS; ++k)
+    {
+        a->clusters[k] += b->clusters[k];
+        a->sites[k] += b->sites[k];
+        a->gyration[k] += b->gyration[k];
+    }
+    a->sum_size += b->sum_size;
+    a->sum_size2 += b->sum_size2;
+    a->spanning += b->spanning;
+    a->spanning_sites += b->spanning_sites;
+}
+
+/**
+ * writes a histogram of an n by n lattice to a file: a comment line with the totals and
+ * the mean cluster size, then a csv line for each bin holding any clusters, with the
+ * number of clusters per site per unit size n_s, and the mean size and radius of gyration
+ */
+void histogram_write(const histogram *h, int n, double p, const char *path)
+{
+    FILE *f = fopen(path, "w");
+    if (f == NULL)
+    {
+        printf("failed to open %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    int64_t total = h->spanning;
+    for (int k = 0; k < HISTOGRAM_BINS; ++k)
+    {
+        total += h->clusters[k];
+    }
+
+    fprintf(f, "# n=%d,p=%.6f,clusters=%" PRId64 ",spanning=%" PRId64 ",spanning_sites=%" PRId64 ",mean_cluster_size=%.6f\n",
+        n, p, total, h->spanning, h->spanning_sites, h->sum_size > 0 ? h->sum_size2 / h->sum_size : 0);
+    fprintf(f, "size_low,size_high,clusters,n_s,mean_size,mean_gyration_radius\n");
+
+    for (int k = 0; k < HISTOGRAM_BINS; ++k)
+    {
+        if (h->clusters[k] == 0)
+        {
+            continue;
+        }
+
+        uint64_t low = (uint64_t) 1 << k;
+        uint64_t high = 2 * low - 1;
+        double count = (double) h->clusters[k];
+        double n_s = count / ((double) n * n * low);
+
+        //root mean square radius of the clusters in the bin
+        fprintf(f, "%" PRIu64 ",%" PRIu64 ",%" PRId64 ",%.6e,%.4f,%.4f\n",
+            low, high, h->clusters[k], n_s, h->sites[k] / count, sqrt(h->gyration[k] / count));
+    }
+
+    fclose(f);
+}
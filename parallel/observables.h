@@ -0,0 +1,35 @@
+#ifndef __OBSERVABLES_H
+#define __OBSERVABLES_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lattice.h"
+
+//bin k holds clusters of 2^k up to 2^(k+1) - 1 sites
+#define HISTOGRAM_BINS 64
+
+//cluster observables gathered while labelling: the cluster size distribution binned
+//logarithmically, and the moments of the sizes - spanning clusters are left out of
+//the bins and moments, as for the mean cluster size in percolation theory
+typedef struct
+{
+    int64_t clusters[HISTOGRAM_BINS]; //number of clusters in each bin
+    double sites[HISTOGRAM_BINS]; //their total size
+    double gyration[HISTOGRAM_BINS]; //total of their squared radii of gyration
+
+    double sum_size; //total size of all clusters counted
+    double sum_size2; //total of the squares of their sizes
+
+    int64_t spanning; //clusters which reach every row or col, or wind round the lattice
+    int64_t spanning_sites; //their total size
+} histogram;
+
+void histogram_init(histogram *h);
+void histogram_add(histogram *h, int64_t size, const double *moments, bool spans);
+void histogram_merge(histogram *a, const histogram *b);
+void histogram_write(const histogram *h, int n, double p, const char *path);
+
+#endif
@@ -1,70 +1,131 @@
 #include "percolation.h"
 
+/**
+ * checks whether a bond from site s in direction d leaves the box
+ */
+bool leaves_box(box b, coord s, int d)
+{
+	return (d == NORTH && s.i == b.il) || (d == SOUTH && s.i == b.iu)
+		|| (d == WEST && s.j == b.jl) || (d == EAST && s.j == b.ju);
+}
+
+/**
+ * records that a cluster leaves the box through site s in direction d
+ */
+void set_edge(region *r, coord s, int d, cluster *c)
+{
+	if (d == NORTH || d == SOUTH)
+	{
+		r->edge[d][s.j - r->b.jl] = c;
+	}
+	else
+	{
+		r->edge[d][s.i - r->b.il] = c;
+	}
+}
+
 /**
  * starting from an initial site, performs a depth first search, marking
  * all visited sites as part of the same cluster
  *
- * only searches within the specified region
+ * only searches within the specified region - the cluster is recorded against
+ * the sites on the edges of the box which have bonds leaving it
+ *
+ * the cluster is connected within the box, so the rows (and cols) it reaches are
+ * the run between the first and last ones, which are stored in `extent'
+ *
+ * if `observe`, the moments of the cluster are summed up too
  */
-void explore_cluster(lattice l, site *initial, box b, stack *stack, bool **visited, cluster *c)
+void explore_cluster(lattice l, coord initial, region *r, stack *stack, bool *visited, cluster *c, box *extent, bool observe)
 {
-	//push the first site onto the cluster
+	box b = r->b;
+	int width = BOX_WIDTH(b);
+
+	extent->il = extent->iu = initial.i;
+	extent->jl = extent->ju = initial.j;
+
+	//push the first site onto the cluster - sites are marked as soon as they are pushed,
+	//so each site goes onto the stack at most once
 	stack_push(stack, initial);
+	visited[(size_t) (initial.i - b.il) * width + (initial.j - b.jl)] = true;
 
 	//continue until no sites left in this box which are connected to the initial site
 	while (!stack_empty(stack))
 	{
 		//look at the next site
-		site *s = stack_pop(stack);
-		int i = s->i;
-		int j = s->j;
-
-		if (visited[i - b.il][j - b.jl])
-		{
-			continue;
-		}
-
-		visited[i - b.il][j - b.jl] = true;
+		coord s = stack_pop(stack);
+		int i = s.i;
+		int j = s.j;
 
 		//add one to the cluster size
 		++c->size;
+		if (observe)
+		{
+			c->moments[MOMENT_I] += i;
+			c->moments[MOMENT_J] += j;
+			c->moments[MOMENT_II] += (double) i * i;
+			c->moments[MOMENT_JJ] += (double) j * j;
+		}
 
-		//allocate the cluster to the site
-		s->cluster = c;
+		//cluster has reached this row and this column
+		extent->il = MIN(extent->il, i);
+		extent->iu = MAX(extent->iu, i);
+		extent->jl = MIN(extent->jl, j);
+		extent->ju = MAX(extent->ju, j);
 
-		if ((i == b.il && s->bond[NORTH]) || (i == b.iu && s->bond[SOUTH]))
+		//away from the edges of the box, no bond leaves it or wraps around, so the
+		//neighbours and their visited flags are plain offsets from the site
+		if (i > b.il && i < b.iu && j > b.jl && j < b.ju)
 		{
-			if (i == b.il && s->bond[NORTH])
+			const site *here = get_site(l, i, j);
+			bool *seen = &visited[(size_t) (i - b.il) * width + (j - b.jl)];
+
+			if ((here[-l.n] & BOND_SOUTH) && !seen[-width])
 			{
-				//site is on the N edge and has bond out of cluster - keep track
-				c->border_sites[c->n_border_sites++] = s;
+				coord n = {i - 1, j};
+				stack_push(stack, n);
+				seen[-width] = true;
 			}
-
-			//site has a connection to outside the box -- mark cluster global
-			c->global = true;
+			if ((here[0] & BOND_EAST) && !seen[1])
+			{
+				coord n = {i, j + 1};
+				stack_push(stack, n);
+				seen[1] = true;
+			}
+			if ((here[0] & BOND_SOUTH) && !seen[width])
+			{
+				coord n = {i + 1, j};
+				stack_push(stack, n);
+				seen[width] = true;
+			}
+			if ((here[-1] & BOND_EAST) && !seen[-1])
+			{
+				coord n = {i, j - 1};
+				stack_push(stack, n);
+				seen[-1] = true;
+			}
+			continue;
 		}
 
-		//cluster has reached this row and this column
-		c->rows[i] = true;
-		c->cols[j] = true;
-
 		for (int d = 0; d < N_DIRECTIONS; ++d)
 		{
 			//neighbour in this direction
-			if (s->bond[d])
+			if (bond(l, s, d))
 			{
-				//ignore if outside local box
-				if ((i == b.il && d == NORTH) || (i == b.iu && d == SOUTH))
+				//site is on the edge and has bond out of box - keep track, and mark cluster global
+				if (leaves_box(b, s, d))
 				{
+					set_edge(r, s, d, c);
+					c->global = true;
 					continue;
 				}
 
-				site *n = neighbour(l, s, d);
-				if (!visited[n->i - b.il][n->j - b.jl] && !n->on_stack)
+				coord n = neighbour(l, s, d);
+				if (!visited[(size_t) (n.i - b.il) * width + (n.j - b.jl)])
 				{
 					//add onto stack if not visited yet
 					stack_push(stack, n);
-					n->on_stack = true;
+					visited[(size_t) (n.i - b.il) * width + (n.j - b.jl)] = true;
 				}
 			}
 		}
@@ -72,215 +133,988 @@ void explore_cluster(lattice l, site *initial, box b, stack *stack, bool **visit
 }
 
 /**
- * given a region to search in, finds clusters within the region,
- * and returns the clusters which leave the north border to the caller 
+ * finds the clusters within a region by depth first search from each unvisited site,
+ * counting those which stay in the box into h if it is given
  */
-cluster **find_global_clusters(lattice l, int initial_id, box b, int *max_size, int *n_clusters)
+void find_global_clusters_dfs(lattice l, region *r, scratch *s, histogram *h)
 {
-	//allocate list with max number of clusters
-	cluster **clusters = malloc(BOX_WIDTH(b) / 2 * sizeof(cluster *));
-	//number of clusters
-	int count = 0;
-	//max cluster size in this region
-	int max = 0;
+	box b = r->b;
+	int width = BOX_WIDTH(b);
 
-	//allocate 2D array to keep track of visited sites in the DFS
-	bool **visited = malloc(BOX_HEIGHT(b) * sizeof(bool *));
-	for (int i = 0; i < BOX_HEIGHT(b); ++i)
-	{
-		visited[i] = calloc(BOX_WIDTH(b), sizeof(bool));
-	}
+	//next free id
+	int initial_id = r->start_label;
+
+	//keep track of visited sites in the DFS, row by row
+	bool *visited = s->visited;
+	memset(visited, 0, (size_t) width * BOX_HEIGHT(b) * sizeof(bool));
+	s->stack.peak = 0;
 
-	//use stack for DFS data structure
-	stack stack;
-	stack_init(&stack, BOX_WIDTH(b) * BOX_HEIGHT(b));
+	//record of a cluster which stayed in the box, free to reuse for the next one
+	cluster *spare = NULL;
 
 	//all sites in region
 	for (int i = b.il; i <= b.iu; ++i)
 	{
 		for (int j = b.jl; j <= b.ju; ++j)
 		{
-			site *s = get_site(l, i, j);
-
 			//check if contains a site, and also hasn't been reached by DFS yet
-			if (s->occupied && !visited[i - b.il][j - b.jl])
+			if ((*get_site(l, i, j) & OCCUPIED) && !visited[(size_t) (i - b.il) * width + (j - b.jl)])
 			{
-				//new site -- create and set up a new cluster
-				cluster *c = calloc(1, sizeof(cluster));
+				//new site -- set up a new cluster
+				cluster *c = spare != NULL ? spare : arena_alloc(&s->arena, sizeof(cluster));
+				memset(c, 0, sizeof(cluster));
 				c->id = initial_id;
-				c->border_sites = malloc(BOX_WIDTH(b) * sizeof(site *));
-				c->rows = calloc(l.n, sizeof(bool));
-				c->cols = calloc(l.n, sizeof(bool));
 
 				//find other sites in the cluster, fill in cluster data
-				explore_cluster(l, s, b, &stack, visited, c);
+				coord initial = {i, j};
+				box extent;
+				explore_cluster(l, initial, r, &s->stack, visited, c, &extent, h != NULL);
 
 				//update max cluster size
-				max = MAX(max, c->size);
+				r->max = MAX(r->max, c->size);
+				r->sites += c->size;
+				++r->found;
 
-				//if cluster reaches outside box, record it, otherwise delete
+				//if cluster reaches outside box, record it, otherwise check it now and reuse its record
 				if (c->global)
 				{
-					clusters[count++] = c;
+					c->rows = arena_alloc(&s->arena, BITSET_WORDS(l.n) * sizeof(uint64_t));
+					c->cols = arena_alloc(&s->arena, BITSET_WORDS(l.n) * sizeof(uint64_t));
+					for (int y = extent.il; y <= extent.iu; ++y)
+					{
+						bitset_set(c->rows, y);
+					}
+					for (int y = extent.jl; y <= extent.ju; ++y)
+					{
+						bitset_set(c->cols, y);
+					}
+
+					r->clusters[r->n_clusters++] = c;
 					initial_id++;
+					spare = NULL;
 				}
 				else
 				{
-					free(c->border_sites);
-					free(c->rows);
-					free(c->cols);
-					free(c);
+					r->spans_rows |= BOX_HEIGHT(extent) == l.n;
+					r->spans_cols |= BOX_WIDTH(extent) == l.n;
+					if (h != NULL)
+					{
+						histogram_add(h, c->size, c->moments, BOX_HEIGHT(extent) == l.n || BOX_WIDTH(extent) == l.n);
+					}
+					spare = c;
 				}
 			}
 		}
 	}
 
-	free(visited);
-
-	*max_size = max;
-	*n_clusters = count;
-
-	return clusters;
+	r->max_stack = s->stack.peak;
 }
 
 /**
- * perform percolation analysis on the given lattice
- * pass in a lattice, whether to check rows, cols, and int address to store max cluster in
- * returns whether lattice percolates, and the size of the max cluster
+ * records the clusters of a region whose sites are labelled in the scratch's label array, with
+ * the size and rows/cols of each cluster kept in `u' - those which leave the box get records,
+ * and those which stay in it are checked (and counted into h if it is given) straight away
  */
-bool percolation(lattice l, bool rows, bool cols, int *max_cluster)
+void record_clusters(lattice l, region *r, scratch *sc, histogram *h, labels *u)
 {
-	int num_threads;
-	#pragma omp parallel
-	num_threads = omp_get_num_threads();
+	box b = r->b;
+	int width = BOX_WIDTH(b);
+	int *label = sc->label;
 
-	//use n boxes for n threads
-	int n_boxes = MIN(num_threads, l.n);
-	int extra = l.n % n_boxes;
+	//canonical label -> cluster record, for clusters which leave the box
+	cluster **of_label = calloc(u->count, sizeof(cluster *));
 
-	//the max over all clusters, of all boxes
-	int full_max = 0;
+	//sites along each edge with bonds leading out of the box
+	for (int d = 0; d < N_DIRECTIONS; ++d)
+	{
+		int length = d == NORTH || d == SOUTH ? width : BOX_HEIGHT(b);
+		for (int x = 0; x < length; ++x)
+		{
+			coord s;
+			s.i = d == NORTH ? b.il : d == SOUTH ? b.iu : b.il + x;
+			s.j = d == WEST ? b.jl : d == EAST ? b.ju : b.jl + x;
 
-	//allocate num clusters, cluster list, max cluster size for each box
-	int *box_n = malloc(n_boxes  * sizeof(int));
-	cluster ***box_clusters = malloc(n_boxes  * sizeof(cluster **));
-	int *maxes = calloc(n_boxes , sizeof(int));
+			if (!bond(l, s, d))
+			{
+				continue;
+			}
 
-	//bounding and labelling info for boxes
-	int start_label = 1;
-	int il = 0;
-	box boxes[n_boxes];
-	int start_labels[n_boxes];
+			int a = labels_find(u, label[(size_t) (s.i - b.il) * width + (s.j - b.jl)]);
 
-	//fill in box info - very inexpensive, very small loop. don't need to parallelise
-	for (int id = 0; id < n_boxes; ++id)
+			//first time this cluster is seen leaving the box - create its record
+			if (of_label[a] == NULL)
+			{
+				cluster *c = arena_alloc(&sc->arena, sizeof(cluster));
+				c->id = r->start_label + r->n_clusters;
+				c->size = u->size[a];
+				c->global = true;
+				c->rows = arena_alloc(&sc->arena, BITSET_WORDS(l.n) * sizeof(uint64_t));
+				c->cols = arena_alloc(&sc->arena, BITSET_WORDS(l.n) * sizeof(uint64_t));
+				for (int y = 0; y < u->rows[a].len; ++y)
+				{
+					bitset_set(c->rows, (u->rows[a].start + y) % l.n);
+				}
+				for (int y = 0; y < u->cols[a].len; ++y)
+				{
+					bitset_set(c->cols, (u->cols[a].start + y) % l.n);
+				}
+
+				if (h != NULL)
+				{
+					memcpy(c->moments, &u->moments[(size_t) a * N_MOMENTS], sizeof(c->moments));
+				}
+
+				of_label[a] = c;
+				r->clusters[r->n_clusters++] = c;
+			}
+
+			set_edge(r, s, d, of_label[a]);
+		}
+	}
+
+	//update max cluster size and check clusters which stay in the box, from every canonical label
+	for (int a = 1; a < u->count; ++a)
 	{
-		//create bounds for overlay lattice box
-		box b;
-		b.il = il;
-		b.iu = il + l.n / n_boxes - 1;
-		b.jl = 0;
-		b.ju = l.n - 1;
-		
-		//if doesn't evenly divide n, add 1 more row if leftover
-		if (id % n_boxes < extra)
+		if (u->parent[a] == a)
 		{
-			++b.iu;
+			r->max = MAX(r->max, u->size[a]);
+			r->sites += u->size[a];
+			++r->found;
+			if (of_label[a] == NULL)
+			{
+				r->spans_rows |= u->rows[a].len == l.n;
+				r->spans_cols |= u->cols[a].len == l.n;
+				if (h != NULL)
+				{
+					histogram_add(h, u->size[a], &u->moments[(size_t) a * N_MOMENTS], u->rows[a].len == l.n || u->cols[a].len == l.n);
+				}
+			}
 		}
+	}
 
-		//store info on this box into array
-		boxes[id] = b;
-		start_labels[id] = start_label;
+	free(of_label);
+}
 
-		//update il and jl for next overlay box
-		il = b.iu + 1;
+/**
+ * finds the clusters within a region in a single raster scan, joining the labels of
+ * each site's N and W neighbours with union-find (Hoshen-Kopelman), counting the
+ * clusters which stay in the box into h if it is given
+ */
+void find_global_clusters_uf(lattice l, region *r, scratch *sc, histogram *h)
+{
+	box b = r->b;
+	int width = BOX_WIDTH(b);
 
-		//increment start label to keep unique amongst boxes
-		start_label += BOX_WIDTH(b) * BOX_HEIGHT(b) / 2;
+	//label of each site in the region, 0 if unoccupied
+	int *label = sc->label;
+
+	labels u;
+	labels_init(&u, l.n, width);
+	if (h != NULL)
+	{
+		labels_observe(&u);
 	}
 
-	//parallel speedup comes here! process boxes on different threads
-	#pragma omp parallel
-	#pragma omp single
-	for (int id = 0; id < n_boxes; ++id)
+	//all sites in region, in memory order
+	for (int i = b.il; i <= b.iu; ++i)
 	{
-		//submit a new task for this box
-		#pragma omp task firstprivate(id)
+		for (int j = b.jl; j <= b.ju; ++j)
 		{
-			int box_max;
-			int n_clusters;
-
-			//calculate max cluster, all global clusters for box
-			cluster **clusters = find_global_clusters(l, start_labels[id], boxes[id], &box_max, &n_clusters);
-			
-			//store important info in array
-			box_n[id] = n_clusters;
-			box_clusters[id] = clusters;
-			maxes[id] = box_max;
+			size_t k = (size_t) (i - b.il) * width + (j - b.jl);
+			coord s = {i, j};
+			const site *here = get_site(l, i, j);
+
+			if (!(*here & OCCUPIED))
+			{
+				label[k] = 0;
+				continue;
+			}
+
+			//labels of the neighbours already scanned within the box - inside it, so never wrapping around
+			int up = i > b.il && (here[-l.n] & BOND_SOUTH) ? label[k - width] : 0;
+			int left = j > b.jl && (here[-1] & BOND_EAST) ? label[k - 1] : 0;
+
+			if (up && left)
+			{
+				label[k] = labels_union(&u, labels_add(&u, up, s), left, s);
+			}
+			else if (up || left)
+			{
+				label[k] = labels_add(&u, up ? up : left, s);
+			}
+			else
+			{
+				label[k] = labels_new(&u, s);
+			}
 		}
 	}
 
-	//completed processing of boxes, now need to patch together
-	//can't get speedup with parallelism here due to required synchronisation
-	//look at each box in turn
-	for (int i = 0; i < n_boxes; ++i)
+	record_clusters(l, r, sc, h, &u);
+	labels_free(&u);
+}
+
+/**
+ * labels the sites of a box by propagating the least label along bonds until none changes, from
+ * each occupied site starting with its own index in the box (plus 1, leaving 0 for unoccupied) -
+ * so each ends up with the least index in its cluster, one site of which every label names
+ *
+ * each round sweeps down the box and back up, taking the label across the bonds from the row
+ * above (below) for a whole row at once, which vectorises, then running along the row each way,
+ * then points every label at the label of the site it names (pointer jumping), which cuts short
+ * long winding paths
+ *
+ * returns whether it settled, and how many rounds it took - giving up after LP_MAX_ROUNDS, or
+ * sooner if the number of labels changed by each round stops falling quickly
+ */
+bool propagate_labels(lattice l, box b, int *label, int *rounds)
+{
+	int width = BOX_WIDTH(b);
+	int height = BOX_HEIGHT(b);
+
+	for (int i = 0; i < height; ++i)
 	{
-		//check if max can be increased here, while doing this patching
-		full_max = MAX(full_max, maxes[i]);
+		const site *row = get_site(l, b.il + i, b.jl);
+		int *lab = &label[(size_t) i * width];
 
-		//iterate over global clusters in box (north side)
-		for (int j = 0; j < box_n[i]; ++j)
+		#pragma omp simd
+		for (int j = 0; j < width; ++j)
 		{
-			cluster *c = box_clusters[i][j];
+			lab[j] = row[j] & OCCUPIED ? i * width + j + 1 : 0;
+		}
+	}
+
+	//labels changed by the last round
+	int64_t last = INT64_MAX;
+
+	for (*rounds = 1; *rounds <= LP_MAX_ROUNDS; ++*rounds)
+	{
+		int64_t changed = 0;
 
-			//loop over border sites of this cluster
-			for (int k = 0; k < c->n_border_sites; ++k)
+		//down the box, then back up
+		for (int pass = 0; pass < 2; ++pass)
+		{
+			for (int x = 0; x < height; ++x)
 			{
-				site *s = c->border_sites[k];
+				int i = pass == 0 ? x : height - 1 - x;
+				const site *row = get_site(l, b.il + i, b.jl);
+				int *lab = &label[(size_t) i * width];
 
-				if (s->bond[NORTH])
+				//from the row just swept, across the S bonds held by whichever is upper
+				if (pass == 0 ? i > 0 : i < height - 1)
 				{
-					site *n = neighbour(l, s, NORTH);
+					const site *upper = pass == 0 ? row - l.n : row;
+					const int *from = pass == 0 ? lab - width : lab + width;
 
-					//if different cluster ids, merge them
-					if (n->cluster != NULL && canonical(c)->id != canonical(n->cluster)->id)
+					//masking rather than branching on the bond, so that it vectorises
+					#pragma omp simd reduction(+:changed)
+					for (int j = 0; j < width; ++j)
 					{
-						merge_clusters(l, c, n->cluster);
+						int bonded = -((upper[j] & BOND_SOUTH) != 0);
+						int across = (from[j] & bonded) | (INT_MAX & ~bonded);
+						int least = MIN(lab[j], across);
+						changed += least != lab[j];
+						lab[j] = least;
 					}
 				}
+
+				//along the row E and then W - each site depends on the one before, so one at a time
+				for (int j = 1; j < width; ++j)
+				{
+					int bonded = -((row[j - 1] & BOND_EAST) != 0);
+					int across = (lab[j - 1] & bonded) | (INT_MAX & ~bonded);
+					changed += across < lab[j];
+					lab[j] = MIN(lab[j], across);
+				}
+				for (int j = width - 2; j >= 0; --j)
+				{
+					int bonded = -((row[j] & BOND_EAST) != 0);
+					int across = (lab[j + 1] & bonded) | (INT_MAX & ~bonded);
+					changed += across < lab[j];
+					lab[j] = MIN(lab[j], across);
+				}
+			}
+		}
+
+		//a round with no change has every pair of bonded sites agreeing
+		if (!changed)
+		{
+			return true;
+		}
+
+		//after the first couple of rounds, which move labels across most sites, a round changing
+		//over half as many labels as the one before is settling too slowly to be worth going on
+		if (*rounds > 2 && 2 * changed > last)
+		{
+			return false;
+		}
+		last = changed;
+
+		//the site a label names is in the same cluster, and its own label is no larger
+		for (size_t k = 0; k < (size_t) width * height; ++k)
+		{
+			if (label[k])
+			{
+				label[k] = label[label[k] - 1];
+			}
+		}
+	}
+
+	return false;
+}
+
+/**
+ * finds the clusters within a region by label propagation (see propagate_labels), counting
+ * the clusters which stay in the box into h if it is given - a box which doesn't settle
+ * quickly, as near p_c where clusters wind about the most, is labelled with union-find
+ * instead, as each round costs about as much as the whole union-find scan
+ */
+void find_global_clusters_lp(lattice l, region *r, scratch *sc, histogram *h)
+{
+	box b = r->b;
+	int width = BOX_WIDTH(b);
+	int *label = sc->label;
+
+	if (!propagate_labels(l, b, label, &r->rounds))
+	{
+		r->fell_back = true;
+		find_global_clusters_uf(l, r, sc, h);
+		return;
+	}
+
+	labels u;
+	labels_init(&u, l.n, width);
+	if (h != NULL)
+	{
+		labels_observe(&u);
+	}
+
+	//one label for each cluster, handed out at its least site, which comes first in memory order
+	for (int i = b.il; i <= b.iu; ++i)
+	{
+		for (int j = b.jl; j <= b.ju; ++j)
+		{
+			size_t k = (size_t) (i - b.il) * width + (j - b.jl);
+			coord s = {i, j};
+
+			if (label[k] == 0)
+			{
+				continue;
+			}
+
+			size_t least = label[k] - 1;
+			label[k] = least == k ? labels_new(&u, s) : labels_add_within(&u, label[least], s);
+		}
+	}
+
+	record_clusters(l, r, sc, h, &u);
+	labels_free(&u);
+}
+
+/**
+ * given a region to search in, finds clusters within the region using the given engine,
+ * and records the clusters which leave the box in the region - the clusters reached
+ * from each edge site are written into the edge arrays
+ *
+ * if a histogram is given, the clusters which stay in the box are counted into it, and
+ * the moments of those which leave it are kept for once they are merged
+ */
+void find_global_clusters(lattice l, engine e, region *r, scratch *s, histogram *h)
+{
+	if (e == ENGINE_UF)
+	{
+		find_global_clusters_uf(l, r, s, h);
+	}
+	else if (e == ENGINE_LP)
+	{
+		find_global_clusters_lp(l, r, s, h);
+	}
+	else
+	{
+		find_global_clusters_dfs(l, r, s, h);
+	}
+}
+
+/**
+ * joins up clusters across the shared edge of two neighbouring boxes, where box b
+ * lies directly S of box a if `vertical`, otherwise directly E of it
+ *
+ * clusters are merged straight away, or if `u` is given, only their ids are joined in it
+ */
+void stitch_boxes(lattice l, region *a, region *b, bool vertical, cuf *u)
+{
+	int length = vertical ? BOX_WIDTH(b->b) : BOX_HEIGHT(b->b);
+
+	//across the periodic edge, the sites of a are a lattice length before those of b
+	int di = vertical && b->b.il == 0 ? -l.n : 0;
+	int dj = !vertical && b->b.jl == 0 ? -l.n : 0;
+
+	//iterate over sites along the N (or W) edge of b
+	for (int x = 0; x < length; ++x)
+	{
+		cluster *c = b->edge[vertical ? NORTH : WEST][x];
+		cluster *n = a->edge[vertical ? SOUTH : EAST][x];
+
+		if (c == NULL || n == NULL)
+		{
+			continue;
+		}
+
+		//if bond leads out of the edge into a different cluster, merge them (or note
+		//that the cluster winds round the lattice, if it is the same one)
+		if (u != NULL)
+		{
+			cuf_union(u, c->id, n->id);
+		}
+		else
+		{
+			merge_clusters(l, c, n, di, dj);
+		}
+	}
+}
+
+/**
+ * joins up the clusters of all boxes by stitching each box to the ones above and to
+ * its left in turn
+ *
+ * can't get speedup with parallelism here due to required synchronisation
+ */
+void merge_serial(lattice l, region *regions, int grid_rows, int grid_cols)
+{
+	//look at each box in turn
+	for (int id = 0; id < grid_rows * grid_cols; ++id)
+	{
+		int gr = id / grid_cols;
+		int gc = id % grid_cols;
+
+		//the boxes above and to the left of this one - the S/E edges of the last boxes
+		//wrap around to the N/W edges of the first
+		region *above = &regions[((gr + grid_rows - 1) % grid_rows) * grid_cols + gc];
+		region *left = &regions[gr * grid_cols + (gc + grid_cols - 1) % grid_cols];
+
+		stitch_boxes(l, above, &regions[id], true, NULL);
+		stitch_boxes(l, left, &regions[id], false, NULL);
+	}
+}
+
+/**
+ * joins up the clusters of all boxes pairwise, as a tree: each level stitches the seam
+ * between neighbouring blocks of boxes, doubling the size of the blocks, first along
+ * each row of the grid and then down the columns, with the periodic seams left to last
+ *
+ * the blocks being joined at any one level are disjoint, and their clusters have only
+ * ever been merged within the block, so the seams of a level can be stitched in parallel
+ */
+void merge_tree(lattice l, region *regions, int grid_rows, int grid_cols)
+{
+	//join blocks of s boxes to their E neighbours, along each row
+	for (int s = 1; s < grid_cols; s *= 2)
+	{
+		int n_seams = (grid_cols - s + 2 * s - 1) / (2 * s);
+
+		#pragma omp parallel for
+		for (int k = 0; k < grid_rows * n_seams; ++k)
+		{
+			int gr = k / n_seams;
+			int gc = s + (k % n_seams) * 2 * s;
+			stitch_boxes(l, &regions[gr * grid_cols + gc - 1], &regions[gr * grid_cols + gc], false, NULL);
+		}
+	}
+
+	//each row is now one block - join blocks of s rows to their S neighbours
+	for (int s = 1; s < grid_rows; s *= 2)
+	{
+		int n_seams = (grid_rows - s + 2 * s - 1) / (2 * s);
+
+		#pragma omp parallel for
+		for (int k = 0; k < n_seams; ++k)
+		{
+			int gr = s + k * 2 * s;
+			for (int gc = 0; gc < grid_cols; ++gc)
+			{
+				stitch_boxes(l, &regions[(gr - 1) * grid_cols + gc], &regions[gr * grid_cols + gc], true, NULL);
 			}
 		}
 	}
 
+	//finally the wraparound from the last column and row of boxes to the first
+	for (int gr = 0; gr < grid_rows; ++gr)
+	{
+		stitch_boxes(l, &regions[gr * grid_cols + grid_cols - 1], &regions[gr * grid_cols], false, NULL);
+	}
+	for (int gc = 0; gc < grid_cols; ++gc)
+	{
+		stitch_boxes(l, &regions[(grid_rows - 1) * grid_cols + gc], &regions[gc], true, NULL);
+	}
+}
+
+/**
+ * called by the task which labelled box `id` once it is done - stitches each seam
+ * shared with a neighbouring box into `u` if that box is done too
+ *
+ * each box has a count for the seams along its N and W edges, which both boxes either
+ * side of the seam bump once done, so exactly one of them sees it reach 2 and stitches it
+ */
+void merge_finished_box(lattice l, region *regions, int grid_rows, int grid_cols, int id, cuf *u, int *seams)
+{
+	int gr = id / grid_cols;
+	int gc = id % grid_cols;
+
+	//the boxes below and to the right of this one, wrapping around
+	int below = ((gr + 1) % grid_rows) * grid_cols + gc;
+	int right = gr * grid_cols + (gc + 1) % grid_cols;
+
+	//N and W seams of this box, then the N seam of the box below and the W seam of the one to the right
+	int seam[4] = {2 * id, 2 * id + 1, 2 * below, 2 * right + 1};
+
+	for (int k = 0; k < 4; ++k)
+	{
+		if (__atomic_add_fetch(&seams[seam[k]], 1, __ATOMIC_ACQ_REL) < 2)
+		{
+			continue;
+		}
+
+		//the box on the other side of a N (W) seam is the one above (to the left)
+		int b = seam[k] / 2;
+		bool vertical = seam[k] % 2 == 0;
+		int bgr = b / grid_cols;
+		int bgc = b % grid_cols;
+		int a = vertical ? ((bgr + grid_rows - 1) % grid_rows) * grid_cols + bgc : bgr * grid_cols + (bgc + grid_cols - 1) % grid_cols;
+
+		stitch_boxes(l, &regions[a], &regions[b], vertical, u);
+	}
+}
+
+/**
+ * once every box has been stitched into `u`, links each cluster record straight to the
+ * record of its canonical id, adding its size and rows/cols onto it
+ */
+void merge_concurrent(lattice l, region *regions, int n_boxes, cuf *u, cluster **by_id)
+{
+	#pragma omp parallel for schedule(dynamic)
+	for (int i = 0; i < n_boxes; ++i)
+	{
+		for (int j = 0; j < regions[i].n_clusters; ++j)
+		{
+			cluster *c = regions[i].clusters[j];
+			cluster *root = by_id[cuf_find(u, c->id)];
+
+			if (root == c)
+			{
+				continue;
+			}
+
+			//many clusters may be added onto the same root at once
+			c->redirect = root;
+			__atomic_add_fetch(&root->size, c->size, __ATOMIC_RELAXED);
+			for (int k = 0; k < BITSET_WORDS(l.n); ++k)
+			{
+				if (c->rows[k]) __atomic_fetch_or(&root->rows[k], c->rows[k], __ATOMIC_RELAXED);
+				if (c->cols[k]) __atomic_fetch_or(&root->cols[k], c->cols[k], __ATOMIC_RELAXED);
+			}
+		}
+	}
+}
+
+/**
+ * number of boxes to split n rows (or cols) into, so that each box is at most `size` long
+ */
+int n_tiles(int n, int size)
+{
+	return MIN(n, (n + size - 1) / size);
+}
+
+/**
+ * lower bound of the t-th of `count` boxes splitting n rows (or cols) as evenly as possible
+ */
+int tile_start(int n, int count, int t)
+{
+	return t * (n / count) + MIN(t, n % count);
+}
+
+/**
+ * initialises an empty workspace - buffers are allocated the first time they are needed
+ */
+void workspace_init(workspace *w)
+{
+	w->threads = NULL;
+	w->n_threads = 0;
+}
+
+/**
+ * cleans up memory held by a workspace
+ */
+void workspace_free(workspace *w)
+{
+	for (int k = 0; k < w->n_threads; ++k)
+	{
+		free(w->threads[k].visited);
+		free(w->threads[k].label);
+		stack_free(&w->threads[k].stack);
+		arena_free(&w->threads[k].arena);
+	}
+	free(w->threads);
+	workspace_init(w);
+}
+
+/**
+ * makes sure a workspace has scratch space for each of `num_threads` threads
+ */
+void workspace_reserve(workspace *w, int num_threads)
+{
+	if (num_threads <= w->n_threads)
+	{
+		return;
+	}
+
+	w->threads = realloc(w->threads, num_threads * sizeof(scratch));
+	if (w->threads == NULL)
+	{
+		printf("failed to alloc\n");
+		exit(EXIT_FAILURE);
+	}
+	memset(w->threads + w->n_threads, 0, (num_threads - w->n_threads) * sizeof(scratch));
+	w->n_threads = num_threads;
+}
+
+/**
+ * returns the calling thread's scratch space, grown if needed to label a box of `sites` sites
+ */
+scratch *get_scratch(workspace *w, size_t sites)
+{
+	scratch *s = &w->threads[omp_get_thread_num()];
+
+	if (s->capacity < sites)
+	{
+		//contents don't need keeping, so free rather than realloc to avoid copying them
+		free(s->visited);
+		free(s->label);
+		if (s->capacity > 0)
+		{
+			stack_free(&s->stack);
+		}
+
+		s->visited = malloc(sites * sizeof(bool));
+		s->label = malloc(sites * sizeof(int));
+		stack_init(&s->stack, sites);
+		if (s->visited == NULL || s->label == NULL)
+		{
+			printf("failed to alloc\n");
+			exit(EXIT_FAILURE);
+		}
+		s->capacity = sites;
+	}
+
+	return s;
+}
+
+/**
+ * allocates the arrays of a region for its box, from the arena of the thread labelling it
+ */
+void region_alloc(region *r, scratch *s)
+{
+	box b = r->b;
+	r->clusters = arena_alloc(&s->arena, 2 * (BOX_WIDTH(b) + BOX_HEIGHT(b)) * sizeof(cluster *));
+	r->edge[NORTH] = arena_alloc(&s->arena, BOX_WIDTH(b) * sizeof(cluster *));
+	r->edge[SOUTH] = arena_alloc(&s->arena, BOX_WIDTH(b) * sizeof(cluster *));
+	r->edge[EAST] = arena_alloc(&s->arena, BOX_HEIGHT(b) * sizeof(cluster *));
+	r->edge[WEST] = arena_alloc(&s->arena, BOX_HEIGHT(b) * sizeof(cluster *));
+}
+
+/**
+ * labels the box of region `id` on the calling thread, and if merging concurrently, joins it up
+ * with any neighbouring boxes which are already done
+ */
+void label_box(lattice l, options o, region *regions, int grid_rows, int grid_cols, int id, workspace *w,
+	cuf *u, cluster **by_id, int *seams)
+{
+	double box_start = omp_get_wtime();
+
+	//calculate max cluster, all global clusters for box
+	box b = regions[id].b;
+	scratch *s = get_scratch(w, (size_t) BOX_WIDTH(b) * BOX_HEIGHT(b));
+
+	region_alloc(&regions[id], s);
+	find_global_clusters(l, o.engine, &regions[id], s, o.observables != NULL ? &s->observed : NULL);
+
+	//join up with any neighbouring boxes which are already done
+	if (o.merge == MERGE_CONCURRENT)
+	{
+		for (int j = 0; j < regions[id].n_clusters; ++j)
+		{
+			by_id[regions[id].clusters[j]->id] = regions[id].clusters[j];
+		}
+		merge_finished_box(l, regions, grid_rows, grid_cols, id, u, seams);
+	}
+
+	regions[id].thread = omp_get_thread_num();
+	regions[id].node = cpu_node();
+	regions[id].time = omp_get_wtime() - box_start;
+}
+
+/**
+ * labels the box of a single region, which must span the whole width of the lattice, joining
+ * up its clusters around the periodic E/W edge - clusters leaving through its N/S edges are
+ * left in r->edge[NORTH] and r->edge[SOUTH] for the caller to join up
+ *
+ * for a band of rows held by one process of a distributed run (see mpi/main.c), where only
+ * the rows of the band and the one above it need to be held - cluster records come from the
+ * workspace, and last until it is next used
+ */
+void label_band(lattice l, engine e, region *r, workspace *w)
+{
+	workspace_reserve(w, 1);
+	arena_reset(&w->threads[0].arena);
+
+	//called from outside any parallel region, so as thread 0
+	scratch *s = get_scratch(w, (size_t) BOX_WIDTH(r->b) * BOX_HEIGHT(r->b));
+	region_alloc(r, s);
+	find_global_clusters(l, e, r, s, NULL);
+	stitch_boxes(l, r, r, false, NULL);
+}
+
+/**
+ * perform percolation analysis on the given lattice
+ * pass in a lattice, whether to check rows, cols, solver options, address to store max cluster in,
+ * optionally where to store the time taken by each phase, and optionally a workspace
+ * whose buffers are kept for the next call
+ * returns whether lattice percolates, and the size of the max cluster - if the options
+ * give a histogram, every cluster is also counted into it, adding onto what it held
+ */
+bool percolation(lattice l, bool rows, bool cols, options o, int64_t *max_cluster, timings *t, workspace *w)
+{
+	int num_threads;
+	#pragma omp parallel
+	num_threads = omp_get_num_threads();
+
+	//without a workspace to reuse, buffers only last for this call
+	workspace own;
+	if (w == NULL)
+	{
+		workspace_init(&own);
+		w = &own;
+	}
+	workspace_reserve(w, num_threads);
+
+	//the concurrent merge only joins up ids, with no offsets to tell a cluster which winds
+	//round the lattice from one which doesn't, so observing merges as a tree instead
+	if (o.observables != NULL)
+	{
+		if (o.merge == MERGE_CONCURRENT)
+		{
+			o.merge = MERGE_TREE;
+		}
+		for (int k = 0; k < w->n_threads; ++k)
+		{
+			histogram_init(&w->threads[k].observed);
+		}
+	}
+
+	//split into a grid of boxes - by default, several bands of rows for each thread, each split
+	//into several boxes, so that a box slow to label (near p_c, one holding much of a giant
+	//cluster) can be left to one thread while the others share out the rest
+	int split = num_threads > 1;
+	int grid_rows = o.tile_rows > 0 ? n_tiles(l.n, o.tile_rows) : MIN(num_threads * (split ? SPLIT_ROWS : 1), l.n);
+	int grid_cols = o.tile_cols > 0 ? n_tiles(l.n, o.tile_cols) : MIN(split ? SPLIT_COLS : 1, l.n);
+	int n_boxes = grid_rows * grid_cols;
+
+	//the max over all clusters, of all boxes
+	int64_t full_max = 0;
+
 	//if need to check for row percolation, set to false, otherwise true
 	bool row_percolation = !rows;
 
 	//likewise for columns
 	bool col_percolation = !cols;
 
+	//bounding and labelling info for boxes, and the clusters found in them
+	region *regions = calloc(n_boxes, sizeof(region));
+	int start_label = 1;
+
+	//fill in box info - very inexpensive, very small loop. don't need to parallelise
+	for (int id = 0; id < n_boxes; ++id)
+	{
+		int gr = id / grid_cols;
+		int gc = id % grid_cols;
+
+		//create bounds for overlay lattice box - if doesn't evenly divide n, earlier
+		//boxes get 1 more row/col
+		box b;
+		b.il = tile_start(l.n, grid_rows, gr);
+		b.iu = tile_start(l.n, grid_rows, gr + 1) - 1;
+		b.jl = tile_start(l.n, grid_cols, gc);
+		b.ju = tile_start(l.n, grid_cols, gc + 1) - 1;
+
+		//store info on this box into array
+		regions[id].b = b;
+		regions[id].start_label = start_label;
+
+		//increment start label to keep unique amongst boxes - only clusters leaving
+		//the box through one of its edges are labelled
+		start_label += 2 * (BOX_WIDTH(b) + BOX_HEIGHT(b));
+	}
+
+	//for merging concurrently: the id sets, the cluster with each id, and how many boxes are done either side of each seam
+	cuf u;
+	cluster **by_id = NULL;
+	int *seams = NULL;
+	if (o.merge == MERGE_CONCURRENT)
+	{
+		cuf_init(&u, start_label);
+		by_id = malloc(start_label * sizeof(cluster *));
+		seams = calloc(2 * n_boxes, sizeof(int));
+	}
+
+	//detailed profile of this call, if asked for
+	profile *p = t != NULL ? t->detail : NULL;
+	if (p != NULL)
+	{
+		profile_start(p);
+	}
+
+	double label_start = omp_get_wtime();
+
+	//each thread starts on its own run of boxes in order, which are the rows it first touched (see
+	//create_lattice), so works out of memory on its own NUMA node until it has to steal
+	steal_queue q;
+	steal_init(&q, n_boxes, num_threads);
+
+	//parallel speedup comes here! process boxes on different threads
+	#pragma omp parallel
+	{
+		int id;
+		bool stolen;
+		while ((id = steal_next(&q, omp_get_thread_num(), &stolen)) >= 0)
+		{
+			label_box(l, o, regions, grid_rows, grid_cols, id, w, &u, by_id, seams);
+			regions[id].stolen = stolen;
+		}
+	}
+	steal_free(&q);
+
+	double label_end = omp_get_wtime();
+	if (p != NULL)
+	{
+		profile_stop(p, PHASE_LABEL);
+		profile_boxes(p, n_boxes, num_threads);
+		for (int id = 0; id < n_boxes; ++id)
+		{
+			box_profile *bp = &p->boxes[id];
+			bp->b = regions[id].b;
+			bp->thread = regions[id].thread;
+			bp->time = regions[id].time;
+			bp->sites = regions[id].sites;
+			bp->clusters = regions[id].found;
+			bp->global = regions[id].n_clusters;
+			bp->max_stack = regions[id].max_stack;
+			bp->cpu_node = regions[id].node;
+			bp->node = box_node(l, regions[id].b);
+			bp->stolen = regions[id].stolen;
+			bp->rounds = regions[id].rounds;
+			bp->fell_back = regions[id].fell_back;
+			p->thread_time[bp->thread] += bp->time;
+		}
+		for (int k = 0; k < num_threads; ++k)
+		{
+			p->thread_idle[k] = label_end - label_start - p->thread_time[k];
+		}
+		profile_start(p);
+	}
+
+	//completed processing of boxes, now need to patch together - timed from here so as to leave out the profiling
+	double merge_start = omp_get_wtime();
+	if (o.merge == MERGE_CONCURRENT)
+	{
+		merge_concurrent(l, regions, n_boxes, &u, by_id);
+		cuf_free(&u);
+		free(by_id);
+		free(seams);
+	}
+	else if (o.merge == MERGE_TREE)
+	{
+		merge_tree(l, regions, grid_rows, grid_cols);
+	}
+	else
+	{
+		merge_serial(l, regions, grid_rows, grid_cols);
+	}
+
+	double reduce_start = omp_get_wtime();
+	if (p != NULL)
+	{
+		profile_stop(p, PHASE_MERGE);
+		profile_start(p);
+	}
+
 	//can parallelise this -- just summing up/reduction
-	#pragma omp parallel for reduction(max:full_max)
+	#pragma omp parallel for reduction(max:full_max) reduction(||:row_percolation, col_percolation)
 	for (int i = 0; i < n_boxes; ++i)
 	{
-		for (int j = 0; j < box_n[i]; ++j)
+		//largest cluster which never left its box
+		full_max = MAX(full_max, regions[i].max);
+
+		//clusters which never left their box were checked while labelling
+		row_percolation = row_percolation || regions[i].spans_rows;
+		col_percolation = col_percolation || regions[i].spans_cols;
+
+		for (int j = 0; j < regions[i].n_clusters; ++j)
 		{
-			cluster *c = box_clusters[i][j];
+			cluster *c = regions[i].clusters[j];
 
 			if (c->redirect == NULL)
 			{
 				//if could potentially be row spanning, check and update if required
-				if (!row_percolation && c->size > l.n) row_percolation = all(c->rows, l.n);
-				
+				if (!row_percolation && c->size >= l.n) row_percolation = bitset_full(c->rows, l.n);
+
 				//likewise for columns
-				if (!col_percolation && c->size > l.n) col_percolation = all(c->cols, l.n);
-				
+				if (!col_percolation && c->size >= l.n) col_percolation = bitset_full(c->cols, l.n);
+
 				//update the max cluster size once merged global clusters
 				full_max = MAX(full_max, c->size);
+
+				if (o.observables != NULL)
+				{
+					histogram_add(&w->threads[omp_get_thread_num()].observed, c->size, c->moments,
+						bitset_full(c->rows, l.n) || bitset_full(c->cols, l.n) || c->wraps);
+				}
 			}
 		}
 	}
 
 	*max_cluster = full_max;
 
+	//per-thread counts of the clusters, summed up
+	if (o.observables != NULL)
+	{
+		for (int k = 0; k < w->n_threads; ++k)
+		{
+			histogram_merge(o.observables, &w->threads[k].observed);
+		}
+	}
+
+	if (p != NULL)
+	{
+		profile_stop(p, PHASE_REDUCE);
+	}
+
+	if (t != NULL)
+	{
+		t->label = label_end - label_start;
+		t->merge = reduce_start - merge_start;
+		t->reduce = omp_get_wtime() - reduce_start;
+	}
+
+	free(regions);
+
+	//clusters and box arrays are all released together, keeping the blocks for the next call
+	for (int k = 0; k < w->n_threads; ++k)
+	{
+		arena_reset(&w->threads[k].arena);
+	}
+
+	if (w == &own)
+	{
+		workspace_free(&own);
+	}
+
 	return row_percolation && col_percolation;
-}
\ No newline at end of file
+}
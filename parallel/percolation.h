@@ -2,12 +2,110 @@
 #define __PERCOLATION_H
 
 #include <stdbool.h>
+#include <string.h>
 #include <math.h>
+#include <limits.h>
 #include <omp.h>
 #include "util.h"
 #include "lattice.h"
 #include "stack.h"
+#include "unionfind.h"
+#include "cuf.h"
+#include "arena.h"
+#include "profile.h"
+#include "observables.h"
+#include "affinity.h"
+#include "steal.h"
 
-bool percolation(lattice, bool, bool, int *);
+//unless tiled, the lattice is split into SPLIT_ROWS bands of rows for each thread, and SPLIT_COLS boxes across
+#define SPLIT_ROWS 2
+#define SPLIT_COLS 4
+
+//algorithm used to label the clusters within each box
+typedef enum
+{
+	ENGINE_DFS, //depth first search out from each unvisited site
+	ENGINE_UF, //raster scan joining labels with union-find (Hoshen-Kopelman)
+	ENGINE_LP //least label propagated along bonds by sweeps over the box, falling back to union-find
+} engine;
+
+//rounds of label propagation a box may take to settle before it is labelled with union-find instead
+#define LP_MAX_ROUNDS 12
+
+//how the clusters of neighbouring boxes are joined up
+typedef enum
+{
+	MERGE_TREE, //pairwise, with neighbouring blocks of boxes joined in parallel at each level
+	MERGE_SERIAL, //one box at a time
+	MERGE_CONCURRENT //by each box as soon as it and its neighbours are labelled, with a lock-free union-find
+} merge;
+
+//how a lattice is split into boxes and labelled
+typedef struct
+{
+	engine engine; //labelling algorithm used within each box
+	merge merge; //how boxes are joined up once labelled
+	int tile_rows, tile_cols; //largest box dimensions, or 0 to split into SPLIT_ROWS x SPLIT_COLS boxes per thread
+	histogram *observables; //if not NULL, every cluster is counted into it while labelling (merges as a tree)
+} options;
+
+//a box of the lattice and the clusters found in it
+typedef struct
+{
+	box b;
+	int start_label; //first id handed out to clusters which leave the box
+
+	cluster **clusters; //clusters which leave the box
+	int n_clusters;
+
+	int64_t max; //size of the largest cluster found within the box
+	bool spans_rows, spans_cols; //whether a cluster which never leaves the box spans
+
+	cluster **edge[N_DIRECTIONS]; //cluster leaving through each site on the N, E, S and W edges, or NULL
+
+	//what labelling the box took, for profiling
+	int sites; //occupied sites
+	int found; //clusters found, whether or not they leave the box
+	int64_t max_stack; //deepest the DFS stack got
+	int rounds; //rounds of label propagation taken
+	bool fell_back; //whether label propagation gave up and it was labelled with union-find
+	int thread; //thread which labelled the box
+	bool stolen; //whether it was taken from another thread's run of boxes
+	int node; //NUMA node of the core it was labelled on, or -1 if not known
+	double time; //wall time spent labelling it
+} region;
+
+//buffers for labelling boxes, kept between boxes and calls so they are allocated once
+typedef struct
+{
+	bool *visited; //sites reached by the DFS
+	int *label; //union-find label of each site
+	stack stack; //sites still to explore in the DFS
+	arena arena; //clusters found and the arrays of boxes labelled, until the end of the call
+	size_t capacity; //number of sites there is room for
+	histogram observed; //clusters counted by this thread during the current call, if observing
+} scratch;
+
+//scratch space for each thread, which can be reused across calls to percolation()
+typedef struct
+{
+	scratch *threads;
+	int n_threads;
+} workspace;
+
+//wall time taken by each phase of the solver, in seconds
+typedef struct
+{
+	double label; //labelling the clusters within each box
+	double merge; //joining up clusters across box edges
+	double reduce; //finding the max cluster and checking spanning
+	profile *detail; //if not NULL, also gets hardware counters of each phase and what happened in each box
+} timings;
+
+void workspace_init(workspace *w);
+void workspace_free(workspace *w);
+bool percolation(lattice, bool, bool, options, int64_t *, timings *, workspace *);
+void label_band(lattice l, engine e, region *r, workspace *w);
+int tile_start(int n, int count, int t);
 
 #endif
@@ -0,0 +1,222 @@
+//for syscall
+#define _DEFAULT_SOURCE
+
+#include <inttypes.h>
+#include "profile.h"
+
+#ifdef __linux__
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+const char *profile_names[PROFILE_PHASES] = {"alloc", "seed", "label", "merge", "reduce"};
+
+/**
+ * opens a hardware counter for the calling thread, returning its file descriptor or -1
+ */
+int open_counter(int counter)
+{
+#ifdef __linux__
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = counter == COUNTER_INSTRUCTIONS ? PERF_COUNT_HW_INSTRUCTIONS : PERF_COUNT_HW_CACHE_MISSES;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    return (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+    (void) counter;
+    return -1;
+#endif
+}
+
+/**
+ * the total of a hardware counter over all threads
+ */
+long long read_counter(profile *p, int counter)
+{
+    long long total = 0;
+#ifdef __linux__
+    for (int k = counter; k < p->n_fds; k += N_COUNTERS)
+    {
+        long long value;
+        if (read(p->fds[k], &value, sizeof(value)) == sizeof(value))
+        {
+            total += value;
+        }
+    }
+#endif
+    return total;
+}
+
+/**
+ * sets up an empty profile, opening hardware counters on each thread of the team if possible -
+ * must be called with the number of threads the run will use already set
+ */
+void profile_init(profile *p)
+{
+    for (int phase = 0; phase < PROFILE_PHASES; ++phase)
+    {
+        p->time[phase] = 0;
+        for (int k = 0; k < N_COUNTERS; ++k)
+        {
+            p->counts[phase][k] = 0;
+        }
+    }
+
+    //set before the counters are opened, as failing to open them frees the profile
+    p->thread_time = NULL;
+    p->thread_idle = NULL;
+    p->boxes = NULL;
+    p->n_boxes = 0;
+
+    p->n_threads = omp_get_max_threads();
+    p->n_fds = p->n_threads * N_COUNTERS;
+    p->fds = malloc(p->n_fds * sizeof(int));
+    if (p->fds == NULL)
+    {
+        printf("failed to alloc\n");
+        exit(EXIT_FAILURE);
+    }
+
+    //counters only count the thread which opened them, so every thread opens its own
+    bool opened = true;
+    #pragma omp parallel reduction(&&:opened)
+    for (int k = 0; k < N_COUNTERS; ++k)
+    {
+        int fd = open_counter(k);
+        p->fds[omp_get_thread_num() * N_COUNTERS + k] = fd;
+        opened = opened && fd >= 0;
+    }
+
+    if (!opened)
+    {
+        profile_free(p);
+    }
+}
+
+/**
+ * cleans up memory and counters held by a profile
+ */
+void profile_free(profile *p)
+{
+#ifdef __linux__
+    for (int k = 0; k < p->n_fds; ++k)
+    {
+        if (p->fds[k] >= 0)
+        {
+            close(p->fds[k]);
+        }
+    }
+#endif
+    free(p->fds);
+    p->fds = NULL;
+    p->n_fds = 0;
+
+    free(p->thread_time);
+    free(p->thread_idle);
+    free(p->boxes);
+    p->thread_time = NULL;
+    p->thread_idle = NULL;
+    p->boxes = NULL;
+}
+
+/**
+ * marks the start of a phase
+ */
+void profile_start(profile *p)
+{
+    for (int k = 0; k < N_COUNTERS; ++k)
+    {
+        p->start_counts[k] = read_counter(p, k);
+    }
+    p->start_time = omp_get_wtime();
+}
+
+/**
+ * marks the end of a phase, adding the time and counts since it started onto it
+ */
+void profile_stop(profile *p, int phase)
+{
+    p->time[phase] += omp_get_wtime() - p->start_time;
+    for (int k = 0; k < N_COUNTERS; ++k)
+    {
+        p->counts[phase][k] += read_counter(p, k) - p->start_counts[k];
+    }
+}
+
+/**
+ * makes room to record each of n_boxes boxes, and the labelling time of each of n_threads threads
+ */
+void profile_boxes(profile *p, int n_boxes, int n_threads)
+{
+    free(p->thread_time);
+    free(p->thread_idle);
+    free(p->boxes);
+
+    p->n_boxes = n_boxes;
+    p->n_threads = n_threads;
+    p->boxes = calloc(n_boxes, sizeof(box_profile));
+    p->thread_time = calloc(n_threads, sizeof(double));
+    p->thread_idle = calloc(n_threads, sizeof(double));
+    if (p->boxes == NULL || p->thread_time == NULL || p->thread_idle == NULL)
+    {
+        printf("failed to alloc\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * prints a profile as a single line of json
+ */
+void profile_print(profile *p)
+{
+    printf("{\"phases\": {");
+    for (int phase = 0; phase < PROFILE_PHASES; ++phase)
+    {
+        printf("%s\"%s\": {\"time\": %.6f", phase > 0 ? ", " : "", profile_names[phase], p->time[phase]);
+        if (p->n_fds > 0)
+        {
+            printf(", \"instructions\": %lld, \"cache_misses\": %lld",
+                p->counts[phase][COUNTER_INSTRUCTIONS], p->counts[phase][COUNTER_CACHE_MISSES]);
+        }
+        printf("}");
+    }
+    printf("}, \"counters\": %s", p->n_fds > 0 ? "true" : "false");
+
+    //how much longer the busiest thread spent labelling than the average
+    double busiest = 0, total = 0;
+    printf(", \"thread_label_time\": [");
+    for (int k = 0; k < p->n_threads && p->thread_time != NULL; ++k)
+    {
+        printf("%s%.6f", k > 0 ? ", " : "", p->thread_time[k]);
+        busiest = MAX(busiest, p->thread_time[k]);
+        total += p->thread_time[k];
+    }
+    printf("], \"imbalance\": %.3f", total > 0 ? busiest * p->n_threads / total : 1.0);
+
+    //time each thread spent waiting for the last boxes to be labelled
+    printf(", \"thread_idle_time\": [");
+    for (int k = 0; k < p->n_threads && p->thread_idle != NULL; ++k)
+    {
+        printf("%s%.6f", k > 0 ? ", " : "", p->thread_idle[k]);
+    }
+    printf("]");
+
+    printf(", \"boxes\": [");
+    for (int k = 0; k < p->n_boxes; ++k)
+    {
+        box_profile *b = &p->boxes[k];
+        printf("%s{\"rows\": [%d, %d], \"cols\": [%d, %d], \"thread\": %d, \"time\": %.6f, ", k > 0 ? ", " : "",
+            b->b.il, b->b.iu, b->b.jl, b->b.ju, b->thread, b->time);
+        printf("\"sites\": %d, \"clusters\": %d, \"global\": %d, \"max_stack\": %" PRId64 ", \"node\": %d, \"cpu_node\": %d, ",
+            b->sites, b->clusters, b->global, b->max_stack, b->node, b->cpu_node);
+        printf("\"stolen\": %s, \"rounds\": %d, \"fell_back\": %s}", b->stolen ? "true" : "false", b->rounds,
+            b->fell_back ? "true" : "false");
+    }
+    printf("]}\n");
+}
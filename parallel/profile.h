@@ -0,0 +1,70 @@
+#ifndef __PROFILE_H
+#define __PROFILE_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <omp.h>
+#include "lattice.h"
+
+//phases of a run which are profiled separately
+#define PHASE_ALLOC     0
+#define PHASE_SEED      1
+#define PHASE_LABEL     2
+#define PHASE_MERGE     3
+#define PHASE_REDUCE    4
+#define PROFILE_PHASES  5
+
+//hardware counters read for each phase
+#define COUNTER_INSTRUCTIONS    0
+#define COUNTER_CACHE_MISSES    1
+#define N_COUNTERS              2
+
+//what happened while labelling one box
+typedef struct
+{
+    box b;
+    int thread; //thread which labelled it
+    double time; //wall time spent labelling it
+    int sites; //occupied sites
+    int clusters; //clusters found in the box, whether or not they leave it
+    int global; //clusters which leave the box
+    int64_t max_stack; //deepest the DFS stack got, 0 for union-find
+    int rounds; //rounds of label propagation taken, 0 for the other engines
+    bool fell_back; //whether label propagation gave up and it was labelled with union-find
+    int node; //NUMA node holding most of its sites, or -1 if not known
+    int cpu_node; //NUMA node of the core it was labelled on, or -1 if not known
+    bool stolen; //whether the thread took it from another thread's run of boxes
+} box_profile;
+
+//opt-in instrumentation of a run: wall time and hardware counters of each phase, time spent
+//labelling by each thread, and what happened in each box
+typedef struct
+{
+    double time[PROFILE_PHASES];
+    long long counts[PROFILE_PHASES][N_COUNTERS];
+
+    //perf_event_open counters of each thread, or none if they couldn't be opened
+    int *fds;
+    int n_fds;
+
+    //state at the start of the current phase
+    double start_time;
+    long long start_counts[N_COUNTERS];
+
+    int n_threads;
+    double *thread_time; //time each thread spent labelling boxes
+    double *thread_idle; //time each thread spent in the label phase without a box to label
+
+    int n_boxes;
+    box_profile *boxes;
+} profile;
+
+void profile_init(profile *p);
+void profile_free(profile *p);
+void profile_start(profile *p);
+void profile_stop(profile *p, int phase);
+void profile_boxes(profile *p, int n_boxes, int n_threads);
+void profile_print(profile *p);
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef __RNG_H
+#define __RNG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//AVX2 kernels are built for x86 with GCC-style target attributes, and used when the CPU has AVX2
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_AVX2 1
+#endif
+
+//independent streams of random numbers drawn for each site
+#define STREAM_SITES        0
+#define STREAM_BONDS_EAST   1
+#define STREAM_BONDS_SOUTH  2
+
+//random order sites/bonds are added in when sweeping over p
+#define STREAM_ORDER        3
+
+//bonds between the layers of a cubic lattice
+#define STREAM_BONDS_DOWN   4
+
+//trial k of line c of a batch, which draws from counters of its own under the batch's one seed - the
+//stream takes the low byte of the third counter word with c (below 2^24) above it, and k the fourth
+//- a single lattice is trial 0
+#define TRIAL(c, k) ((uint64_t) (c) << 32 | (uint32_t) (k))
+
+extern bool simd_enabled;
+
+bool use_avx2(void);
+void philox(uint64_t seed, const uint32_t ctr[4], uint32_t out[4]);
+void rng_row(uint64_t seed, uint64_t trial, uint32_t stream, int i, int n, uint32_t *out);
+uint64_t rng_threshold(double p);
+
+#endif
@@ -1,12 +1,14 @@
 #include "stack.h"
 
 /**
- * initialises a given stack to hold `max` elements at most
+ * initialises a given stack with room for `max` elements to begin with
  */
-void stack_init(stack *s, int max)
+void stack_init(stack *s, size_t max)
 {
     s->size = 0;
-    s->data = malloc(max * sizeof(site *));
+    s->max = MAX(max, 1);
+    s->peak = 0;
+    s->data = malloc(s->max * sizeof(coord));
     if (s->data == NULL)
     {
         printf("failed to alloc\n");
@@ -17,17 +19,29 @@ void stack_init(stack *s, int max)
 /**
  * adds a site to the top of the stack
  */
-void stack_push(stack *s, site *d)
+void stack_push(stack *s, coord d)
 {
+    if (s->size == s->max)
+    {
+        s->max *= 2;
+        s->data = realloc(s->data, s->max * sizeof(coord));
+        if (s->data == NULL)
+        {
+            printf("failed to alloc\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
     s->data[s->size++] = d;
+    s->peak = MAX(s->peak, s->size);
 }
 
 /**
  * pops a site off the top of the stack
  */
-site *stack_pop(stack *s)
+coord stack_pop(stack *s)
 {
-    site *tmp = s->data[s->size - 1];
+    coord tmp = s->data[s->size - 1];
     --s->size;
     return tmp;
 }
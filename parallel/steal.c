@@ -0,0 +1,85 @@
+#include "steal.h"
+
+/**
+ * splits the ids 0 .. n - 1 into one run of consecutive ids for each of n_threads threads, as
+ * evenly as possible with earlier runs 1 longer, in the same way as the rows of a lattice are
+ * split between threads
+ */
+void steal_init(steal_queue *q, int n, int n_threads)
+{
+    q->n_threads = n_threads;
+    q->runs = calloc((size_t) n_threads * RUN_STRIDE, sizeof(uint64_t));
+    if (q->runs == NULL)
+    {
+        printf("failed to alloc\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int t = 0; t < n_threads; ++t)
+    {
+        uint64_t next = t * (n / n_threads) + MIN(t, n % n_threads);
+        uint64_t end = (t + 1) * (n / n_threads) + MIN(t + 1, n % n_threads);
+        q->runs[t * RUN_STRIDE] = end << 32 | next;
+    }
+}
+
+/**
+ * cleans up memory held by a work stealing queue
+ */
+void steal_free(steal_queue *q)
+{
+    free(q->runs);
+}
+
+/**
+ * returns the next id for the given thread to work on, and whether it was stolen from another
+ * thread's run, or -1 once every id has been handed out
+ */
+int steal_next(steal_queue *q, int thread, bool *stolen)
+{
+    //the front of its own run, while there is any left
+    uint64_t *own = &q->runs[thread * RUN_STRIDE];
+    uint64_t r = __atomic_load_n(own, __ATOMIC_ACQUIRE);
+    while ((uint32_t) r < (uint32_t) (r >> 32))
+    {
+        if (__atomic_compare_exchange_n(own, &r, r + 1, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        {
+            *stolen = false;
+            return (int) (uint32_t) r;
+        }
+    }
+
+    //then the back of the longest run left, which is the one most likely to hold up the rest
+    *stolen = true;
+    while (true)
+    {
+        int victim = -1;
+        uint32_t most = 0;
+        for (int t = 0; t < q->n_threads; ++t)
+        {
+            r = __atomic_load_n(&q->runs[t * RUN_STRIDE], __ATOMIC_ACQUIRE);
+            uint32_t left = (uint32_t) (r >> 32) - (uint32_t) r;
+            if ((uint32_t) r < (uint32_t) (r >> 32) && left > most)
+            {
+                victim = t;
+                most = left;
+            }
+        }
+
+        if (victim < 0)
+        {
+            return -1;
+        }
+
+        //shorten it by one from the end, or look again if it changed in the meantime
+        uint64_t *run = &q->runs[victim * RUN_STRIDE];
+        r = __atomic_load_n(run, __ATOMIC_ACQUIRE);
+        uint32_t next = (uint32_t) r;
+        uint32_t end = (uint32_t) (r >> 32);
+        if (next < end && __atomic_compare_exchange_n(run, &r, (uint64_t) (end - 1) << 32 | next, false,
+            __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        {
+            return (int) (end - 1);
+        }
+    }
+}
@@ -0,0 +1,27 @@
+#ifndef __STEAL_H
+#define __STEAL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "util.h"
+
+//words apart the runs of each thread are kept, so that each has a cache line to itself
+#define RUN_STRIDE 8
+
+//the ids 0 .. n - 1 of boxes to label, shared out by work stealing: each thread starts with a
+//run of consecutive ids, taken from the front, and once it runs out takes ids one at a time
+//from the back of whichever run has the most left - safe to use from many threads at once
+//without locks, as each run is one word (end << 32 | next) updated with a compare-and-swap
+typedef struct
+{
+    uint64_t *runs;
+    int n_threads;
+} steal_queue;
+
+void steal_init(steal_queue *q, int n, int n_threads);
+void steal_free(steal_queue *q);
+int steal_next(steal_queue *q, int thread, bool *stolen);
+
+#endif
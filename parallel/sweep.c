@@ -0,0 +1,209 @@
+#include "sweep.h"
+
+/**
+ * allocates the observables for a sweep over m sites/bonds
+ */
+sweep sweep_init(int64_t m)
+{
+    sweep s;
+    s.m = m;
+    s.percolates = calloc(m + 1, sizeof(bool));
+    s.max_cluster = calloc(m + 1, sizeof(int64_t));
+    if (s.percolates == NULL || s.max_cluster == NULL)
+    {
+        printf("failed to alloc\n");
+        exit(EXIT_FAILURE);
+    }
+    return s;
+}
+
+/**
+ * a random order for m sites/bonds, shuffled with Fisher-Yates - the k-th swap
+ * draws from the counter-based generator at counter k, so only depends on the seed
+ * - m is at most 2 * SWEEP_MAX_SIZE^2, which is below 2^32, so k fits the counter
+ */
+int64_t *random_order(int64_t m, uint64_t seed)
+{
+    int64_t *order = malloc(m * sizeof(int64_t));
+    if (order == NULL)
+    {
+        printf("failed to alloc\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int64_t k = 0; k < m; ++k)
+    {
+        order[k] = k;
+    }
+
+    for (int64_t k = m - 1; k > 0; --k)
+    {
+        uint32_t ctr[4] = {(uint32_t) k, 0, STREAM_ORDER, 0};
+        uint32_t r[4];
+        philox(seed, ctr, r);
+
+        //scale the random number down to 0 .. k
+        int64_t swap = (int64_t) (((uint64_t) r[0] * (k + 1)) >> 32);
+        int64_t t = order[k];
+        order[k] = order[swap];
+        order[swap] = t;
+    }
+
+    return order;
+}
+
+/**
+ * records the observables after the k-th site/bond has been added, given the canonical
+ * label of the cluster it joined
+ */
+void sweep_record(sweep *s, labels *u, int64_t k, int a, bool rows, bool cols, bool *spans_rows, bool *spans_cols)
+{
+    //clusters only grow, so once spanning, always spanning
+    *spans_rows |= u->rows[a].len == u->n;
+    *spans_cols |= u->cols[a].len == u->n;
+
+    s->max_cluster[k] = MAX(s->max_cluster[k - 1], u->size[a]);
+    s->percolates[k] = (!rows || *spans_rows) && (!cols || *spans_cols);
+}
+
+/**
+ * Newman-Ziff sweep for site percolation on an n by n lattice: occupies the sites one at a time,
+ * joining each to the clusters of its occupied neighbours with union-find
+ */
+sweep sweep_sites(int n, bool rows, bool cols, uint64_t seed)
+{
+    int64_t m = (int64_t) n * n;
+    sweep s = sweep_init(m);
+    int64_t *order = random_order(m, seed);
+    lattice l = {NULL, n};
+
+    //label of each site, 0 while unoccupied
+    int *label = calloc(m, sizeof(int));
+
+    labels u;
+    labels_init(&u, n, m + 1);
+
+    bool spans_rows = false;
+    bool spans_cols = false;
+
+    for (int64_t k = 1; k <= m; ++k)
+    {
+        coord c = {(int) (order[k - 1] / n), (int) (order[k - 1] % n)};
+        int a = labels_new(&u, c);
+        label[order[k - 1]] = a;
+
+        //site percolation - bonds to every occupied neighbour
+        for (int d = 0; d < N_DIRECTIONS; ++d)
+        {
+            coord x = neighbour(l, c, d);
+            int b = label[(int64_t) x.i * n + x.j];
+            if (b != 0)
+            {
+                a = labels_union(&u, a, b, c);
+            }
+        }
+
+        sweep_record(&s, &u, k, labels_find(&u, a), rows, cols, &spans_rows, &spans_cols);
+    }
+
+    labels_free(&u);
+    free(label);
+    free(order);
+
+    return s;
+}
+
+/**
+ * Newman-Ziff sweep for bond percolation on an n by n lattice: adds the E/S bonds of every site
+ * one at a time, joining the clusters either end - a site counts as occupied once it has a bond
+ */
+sweep sweep_bonds(int n, bool rows, bool cols, uint64_t seed)
+{
+    int64_t m = 2 * (int64_t) n * n;
+    sweep s = sweep_init(m);
+    int64_t *order = random_order(m, seed);
+    lattice l = {NULL, n};
+
+    //every site starts as a cluster of its own, which doesn't count until it has a bond
+    labels u;
+    labels_init(&u, n, n * n + 1);
+    for (int x = 0; x < n * n; ++x)
+    {
+        coord c = {x / n, x % n};
+        labels_new(&u, c);
+    }
+
+    bool spans_rows = false;
+    bool spans_cols = false;
+
+    for (int64_t k = 1; k <= m; ++k)
+    {
+        //bond 2x leads E from site x, bond 2x + 1 leads S
+        int x = (int) (order[k - 1] / 2);
+        coord c = {x / n, x % n};
+        coord y = neighbour(l, c, order[k - 1] % 2 == 0 ? EAST : SOUTH);
+
+        int a = labels_union(&u, x + 1, y.i * n + y.j + 1, c);
+        sweep_record(&s, &u, k, a, rows, cols, &spans_rows, &spans_cols);
+    }
+
+    labels_free(&u);
+    free(order);
+
+    return s;
+}
+
+/**
+ * converts a sweep to the observables at occupation probability p, by weighting the result after
+ * each k sites/bonds by the binomial probability of exactly k of the m being occupied
+ *
+ * the weights are built up outwards from the most likely k, stopping once negligible
+ */
+void sweep_at(sweep s, double p, double *percolates, double *max_cluster)
+{
+    if (p <= 0 || p >= 1)
+    {
+        int64_t k = p <= 0 ? 0 : s.m;
+        *percolates = s.percolates[k];
+        *max_cluster = s.max_cluster[k];
+        return;
+    }
+
+    int64_t mode = MIN(s.m, (int64_t) (p * (s.m + 1)));
+    double ratio = p / (1 - p);
+
+    //weight of the mode is 1 to begin with - everything is normalised at the end
+    double total = 1;
+    double sum_percolates = s.percolates[mode];
+    double sum_max = s.max_cluster[mode];
+
+    double w = 1;
+    for (int64_t k = mode + 1; k <= s.m && w > 1e-16; ++k)
+    {
+        w *= ratio * (s.m - k + 1) / k;
+        total += w;
+        sum_percolates += w * s.percolates[k];
+        sum_max += w * s.max_cluster[k];
+    }
+
+    w = 1;
+    for (int64_t k = mode - 1; k >= 0 && w > 1e-16; --k)
+    {
+        w *= (k + 1) / (ratio * (s.m - k));
+        total += w;
+        sum_percolates += w * s.percolates[k];
+        sum_max += w * s.max_cluster[k];
+    }
+
+    *percolates = sum_percolates / total;
+    *max_cluster = sum_max / total;
+}
+
+/**
+ * cleans up memory held by a sweep
+ */
+void sweep_free(sweep s)
+{
+    free(s.percolates);
+    free(s.max_cluster);
+}
@@ -0,0 +1,26 @@
+#ifndef __SWEEP_H
+#define __SWEEP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "lattice.h"
+#include "unionfind.h"
+
+//largest lattice a sweep can run on - sites are numbered and labelled with ints, and the swaps
+//shuffling the 2n^2 bonds are drawn at 32 bit counters, so n^2 + 1 must fit an int
+#define SWEEP_MAX_SIZE 46340
+
+//observables over a whole Newman-Ziff sweep, as sites (or bonds) are added one at a time in random order
+typedef struct
+{
+    int64_t m; //number of sites (or bonds) added in total
+    bool *percolates; //whether the lattice percolates once k of them have been added, for k = 0 .. m
+    int64_t *max_cluster; //size of the largest cluster once k of them have been added
+} sweep;
+
+sweep sweep_sites(int n, bool rows, bool cols, uint64_t seed);
+sweep sweep_bonds(int n, bool rows, bool cols, uint64_t seed);
+void sweep_at(sweep s, double p, double *percolates, double *max_cluster);
+void sweep_free(sweep s);
+
+#endif
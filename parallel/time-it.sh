@@ -1,22 +1,12 @@
-#/bin/bash
+#!/bin/bash
 
-k=$1
+# times each phase of the solver for n = 1000, 2000, ..., 15000 on 2 to 4 threads,
+# with the benchmark driver (see bench/suite for more options) - prints csv
+k=${1:-s}
 p=0.592746
 if [ "$k" == "b" ]
 then
 	p=0.5
 fi
 
-for e in {1..15}
-do
-	let n=1000*e # n = 1000, 2000, 3000 ...
-	for c in {1..5} # number of times to execute
-	do
-		for t in {2..4} # number of threads
-		do
-			r=$(./main $n $p $k 2 $t) # execute percolation program
-            f=$(echo ${r##*=} | sed 's/.$//')
-			echo $n $t $f # print time taken
-		done
-	done
-done
+make -s bench && bench/suite --model $k --p $p --n $(seq -s, 1000 1000 15000) --threads 2,3,4 --reps 5
@@ -0,0 +1,256 @@
+#include <string.h>
+#include "unionfind.h"
+
+/**
+ * grows the label arrays to hold at least `max` labels
+ */
+void labels_grow(labels *u, int max)
+{
+    u->max = max;
+    u->parent = realloc(u->parent, max * sizeof(int));
+    u->size = realloc(u->size, max * sizeof(int64_t));
+    u->rows = realloc(u->rows, max * sizeof(span));
+    u->cols = realloc(u->cols, max * sizeof(span));
+    if (u->parent == NULL || u->size == NULL || u->rows == NULL || u->cols == NULL)
+    {
+        printf("failed to alloc\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (u->moments != NULL)
+    {
+        u->moments = realloc(u->moments, (size_t) max * N_MOMENTS * sizeof(double));
+        if (u->moments == NULL)
+        {
+            printf("failed to alloc\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (u->layers != NULL)
+    {
+        u->layers = realloc(u->layers, max * sizeof(span));
+        if (u->layers == NULL)
+        {
+            printf("failed to alloc\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+/**
+ * initialises an empty set of labels for an n by n lattice, with room for `max` labels to begin with
+ */
+void labels_init(labels *u, int n, int max)
+{
+    u->parent = NULL;
+    u->size = NULL;
+    u->rows = NULL;
+    u->cols = NULL;
+    u->moments = NULL;
+    u->layers = NULL;
+    u->n = n;
+    labels_grow(u, MAX(max, 2));
+
+    //label 0 is never handed out
+    u->count = 1;
+}
+
+/**
+ * cleans up memory held by a set of labels
+ */
+void labels_free(labels *u)
+{
+    free(u->parent);
+    free(u->size);
+    free(u->rows);
+    free(u->cols);
+    free(u->moments);
+    free(u->layers);
+}
+
+/**
+ * starts keeping the moments of each label, which must be done before any are handed out
+ */
+void labels_observe(labels *u)
+{
+    u->moments = malloc((size_t) u->max * N_MOMENTS * sizeof(double));
+    if (u->moments == NULL)
+    {
+        printf("failed to alloc\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * starts keeping the layers each label reaches, for the labels of a cubic lattice, which must be done
+ * before any are handed out
+ */
+void labels_layered(labels *u)
+{
+    u->layers = malloc(u->max * sizeof(span));
+    if (u->layers == NULL)
+    {
+        printf("failed to alloc\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * adds the site c onto the moments of label a, if they are kept
+ */
+void labels_moments_add(labels *u, int a, coord c)
+{
+    if (u->moments != NULL)
+    {
+        double *m = &u->moments[(size_t) a * N_MOMENTS];
+        m[MOMENT_I] += c.i;
+        m[MOMENT_J] += c.j;
+        m[MOMENT_II] += (double) c.i * c.i;
+        m[MOMENT_JJ] += (double) c.j * c.j;
+    }
+}
+
+/**
+ * hands out a new label for a cluster holding the single site c
+ */
+int labels_new(labels *u, coord c)
+{
+    if (u->count == u->max)
+    {
+        labels_grow(u, 2 * u->max);
+    }
+
+    int a = u->count++;
+    u->parent[a] = a;
+    u->size[a] = 1;
+    u->rows[a] = span_point(c.i);
+    u->cols[a] = span_point(c.j);
+    if (u->moments != NULL)
+    {
+        memset(&u->moments[(size_t) a * N_MOMENTS], 0, N_MOMENTS * sizeof(double));
+        labels_moments_add(u, a, c);
+    }
+    return a;
+}
+
+/**
+ * returns the canonical label of the cluster that label a belongs to, compressing the path on the way
+ */
+int labels_find(labels *u, int a)
+{
+    int root = a;
+    while (u->parent[root] != root)
+    {
+        root = u->parent[root];
+    }
+
+    //point everything on the path straight at the root
+    while (u->parent[a] != root)
+    {
+        int next = u->parent[a];
+        u->parent[a] = root;
+        a = next;
+    }
+
+    return root;
+}
+
+/**
+ * adds the site c to the cluster with label a, where c is bonded to a site of that cluster
+ * returns the canonical label of the cluster
+ */
+int labels_add(labels *u, int a, coord c)
+{
+    a = labels_find(u, a);
+    ++u->size[a];
+    u->rows[a] = span_join(u->rows[a], span_point(c.i), c.i, u->n);
+    u->cols[a] = span_join(u->cols[a], span_point(c.j), c.j, u->n);
+    labels_moments_add(u, a, c);
+    return a;
+}
+
+/**
+ * adds the site c to the cluster with canonical label a, where the cluster lies within a box
+ * which doesn't wrap around the lattice, so c needn't be bonded to any site of it added yet
+ * returns a
+ */
+int labels_add_within(labels *u, int a, coord c)
+{
+    int rows_end = MAX(u->rows[a].start + u->rows[a].len, c.i + 1);
+    int cols_end = MAX(u->cols[a].start + u->cols[a].len, c.j + 1);
+
+    ++u->size[a];
+    u->rows[a].start = MIN(u->rows[a].start, c.i);
+    u->rows[a].len = rows_end - u->rows[a].start;
+    u->cols[a].start = MIN(u->cols[a].start, c.j);
+    u->cols[a].len = cols_end - u->cols[a].start;
+    labels_moments_add(u, a, c);
+    return a;
+}
+
+/**
+ * specifies that the clusters with labels a and b are the same, where the site c belongs
+ * to a and is bonded to a site belonging to b
+ * returns the canonical label of the merged cluster
+ */
+int labels_union(labels *u, int a, int b, coord c)
+{
+    a = labels_find(u, a);
+    b = labels_find(u, b);
+
+    if (a == b) return a;
+
+    //link smaller cluster into larger one - swap if needed
+    if (u->size[a] < u->size[b])
+    {
+        int t = a;
+        a = b;
+        b = t;
+    }
+
+    u->parent[b] = a;
+    if (u->moments != NULL)
+    {
+        add_moments(&u->moments[(size_t) a * N_MOMENTS], &u->moments[(size_t) b * N_MOMENTS], u->size[b], 0, 0);
+    }
+    u->size[a] += u->size[b];
+    u->rows[a] = span_join(u->rows[a], u->rows[b], c.i, u->n);
+    u->cols[a] = span_join(u->cols[a], u->cols[b], c.j, u->n);
+    return a;
+}
+
+/**
+ * hands out a new label for a whole cluster of `size` sites, reaching the given rows and cols
+ */
+int labels_push(labels *u, int64_t size, span rows, span cols)
+{
+    if (u->count == u->max)
+    {
+        labels_grow(u, 2 * u->max);
+    }
+
+    int b = u->count++;
+    u->parent[b] = b;
+    u->size[b] = size;
+    u->rows[b] = rows;
+    u->cols[b] = cols;
+    return b;
+}
+
+/**
+ * hands out a new label for the whole cluster with canonical label a in another set of labels
+ */
+int labels_copy(labels *u, labels *from, int a)
+{
+    int b = labels_push(u, from->size[a], from->rows[a], from->cols[a]);
+    if (u->moments != NULL && from->moments != NULL)
+    {
+        memcpy(&u->moments[(size_t) b * N_MOMENTS], &from->moments[(size_t) a * N_MOMENTS], N_MOMENTS * sizeof(double));
+    }
+    if (u->layers != NULL && from->layers != NULL)
+    {
+        u->layers[b] = from->layers[a];
+    }
+    return b;
+}
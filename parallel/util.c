@@ -9,11 +9,128 @@ int mod_p(int i, int n)
 }
 
 /**
- * checks if all the elements in a boolean array are true
+ * the span covering the single row/col x
  */
-bool all(bool *b, int n)
+span span_point(int x)
 {
-	for (int i = 0; i < n; ++i)
-		if (!b[i]) return false;
-	return true;
-}
\ No newline at end of file
+    span s = {x, 1};
+    return s;
+}
+
+/**
+ * how far a span reaches below and above a pivot, where the span either
+ * contains the pivot or ends right next to it
+ */
+void span_reach(span s, int pivot, int n, int *below, int *above)
+{
+    int d = WRAP(pivot - s.start, n);
+    if (d < s.len)
+    {
+        //pivot inside span
+        *below = d;
+        *above = s.len - 1 - d;
+    }
+    else if (d == s.len)
+    {
+        //pivot just past the end
+        *below = s.len;
+        *above = 0;
+    }
+    else
+    {
+        //pivot just before the start
+        *below = 0;
+        *above = s.len;
+    }
+}
+
+/**
+ * joins the rows/cols covered by two connected groups of sites which are linked
+ * through the row/col `pivot` - each span must contain or be next to the pivot,
+ * in which case the result is exact, as the union of the two is again a run
+ */
+span span_join(span a, span b, int pivot, int n)
+{
+    if (a.len >= n || b.len >= n)
+    {
+        span full = {0, n};
+        return full;
+    }
+
+    int a_below, a_above, b_below, b_above;
+    span_reach(a, pivot, n, &a_below, &a_above);
+    span_reach(b, pivot, n, &b_below, &b_above);
+
+    int below = MAX(a_below, b_below);
+    int above = MAX(a_above, b_above);
+
+    span s = {WRAP(pivot - below, n), MIN(below + above + 1, n)};
+    if (s.len == n)
+    {
+        s.start = 0;
+    }
+    return s;
+}
+
+/**
+ * sets bit i of a bitset
+ */
+void bitset_set(uint64_t *b, int i)
+{
+    b[i / 64] |= (uint64_t) 1 << (i % 64);
+}
+
+/**
+ * sets every bit of bitset a which is set in bitset b, where both hold n bits
+ */
+void bitset_or(uint64_t *a, const uint64_t *b, int n)
+{
+    for (int k = 0; k < BITSET_WORDS(n); ++k)
+    {
+        a[k] |= b[k];
+    }
+}
+
+/**
+ * checks if all n bits of a bitset are set - bits past n are never set, so this is a popcount
+ */
+bool bitset_full(const uint64_t *b, int n)
+{
+    int count = 0;
+    for (int k = 0; k < BITSET_WORDS(n); ++k)
+    {
+        count += __builtin_popcountll(b[k]);
+    }
+    return count == n;
+}
+
+/**
+ * the run of bits set in a bitset of n bits, which must all be in one run wrapping around mod n
+ * - the run starts at the set bit whose predecessor isn't set
+ */
+span bitset_span(const uint64_t *b, int n)
+{
+    span s = {0, 0};
+    for (int k = 0; k < BITSET_WORDS(n); ++k)
+    {
+        s.len += __builtin_popcountll(b[k]);
+    }
+    if (s.len == 0 || s.len == n)
+    {
+        return s;
+    }
+
+    //bit n - 1 comes before bit 0
+    uint64_t carry = (b[(n - 1) / 64] >> ((n - 1) % 64)) & 1;
+    for (int k = 0; k < BITSET_WORDS(n); ++k)
+    {
+        uint64_t starts = b[k] & ~((b[k] << 1) | carry);
+        if (starts != 0)
+        {
+            s.start = k * 64 + __builtin_ctzll(starts);
+            break;
+        }
+        carry = b[k] >> 63;
+    }
+    return s;
+}
@@ -2,12 +2,33 @@
 #define __UTIL_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #define MAX(x, y) (((x) > (y)) ? (x) : (y))
 #define MIN(x, y) (((x) < (y)) ? (x) : (y))
 
+//x wrapped into 0, ..., n - 1, for x at most n out either way - unlike mod_p, without a division,
+//and with just a mask when n is a power of two
+#define IS_POW2(n) (((n) & ((n) - 1)) == 0)
+#define WRAP(x, n) (IS_POW2(n) ? (x) & ((n) - 1) : (x) < 0 ? (x) + (n) : (x) >= (n) ? (x) - (n) : (x))
+
+//number of 64-bit words holding a bitset of n bits
+#define BITSET_WORDS(n) (((n) + 63) / 64)
+
+//a run of rows (or cols) start, start + 1, ..., start + len - 1, wrapping around mod n
+typedef struct
+{
+    int start, len;
+} span;
+
 int mod_p(int i, int n);
 
-bool all(bool *b, int n);
+span span_point(int x);
+span span_join(span a, span b, int pivot, int n);
+
+void bitset_set(uint64_t *b, int i);
+void bitset_or(uint64_t *a, const uint64_t *b, int n);
+bool bitset_full(const uint64_t *b, int n);
+span bitset_span(const uint64_t *b, int n);
 
 #endif
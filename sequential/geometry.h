@@ -0,0 +1,36 @@
+#ifndef __GEOMETRY_H
+#define __GEOMETRY_H
+
+#include "lattice.h"
+
+//neighbours of the site (i, j) in each geometry, as X(di, dj, bond) for the neighbour (i + di, j + dj) -
+//bond tests the site `here' (MINE) or the neighbour `there' (THEIRS), as only E/S/SE bonds are stored
+//
+//the bonds a raster scan hasn't reached yet (di > 0, or di = 0 and dj > 0) must all be E, S or SE,
+//so the ones wrapping around the lattice all start in the last row or column
+#define MINE(bit) ((here) & (bit))
+#define THEIRS(bit) ((there) & (bit))
+
+#define SQUARE_NEIGHBOURS(X) \
+    X(-1, 0, THEIRS(BOND_SOUTH)) \
+    X(0, 1, MINE(BOND_EAST)) \
+    X(1, 0, MINE(BOND_SOUTH)) \
+    X(0, -1, THEIRS(BOND_EAST))
+
+#define TRIANGULAR_NEIGHBOURS(X) \
+    SQUARE_NEIGHBOURS(X) \
+    X(1, 1, MINE(BOND_DIAGONAL)) \
+    X(-1, -1, THEIRS(BOND_DIAGONAL))
+
+//a brick wall - sites with i + j even only have a S bond, odd ones a N bond
+#define UPRIGHT(i, j) (((i) + (j)) % 2 == 0)
+#define HONEYCOMB_NEIGHBOURS(X) \
+    X(0, 1, MINE(BOND_EAST)) \
+    X(UPRIGHT(i, j) ? 1 : -1, 0, UPRIGHT(i, j) ? MINE(BOND_SOUTH) : THEIRS(BOND_SOUTH)) \
+    X(0, -1, THEIRS(BOND_EAST))
+
+//name of a kernel specialised for a geometry, e.g. percolation_dfs_square
+#define KERNEL_PASTE(name, g) name##_##g
+#define KERNEL_NAME(name, g) KERNEL_PASTE(name, g)
+
+#endif
@@ -0,0 +1,297 @@
+//labelling kernels specialised for one geometry - percolation.c includes this once per geometry, with
+//GEOMETRY naming it and NEIGHBOURS(X) listing its neighbours (see geometry.h), so every neighbour is
+//visited by straight-line code with constant offsets rather than a loop over directions
+
+#define KERNEL(name) KERNEL_NAME(name, GEOMETRY)
+
+/**
+ * performs dfs from an unvisited site to find full cluster
+ */
+void KERNEL(percolate_from)(lattice l, stack stack, bool **visited, bool *rows, bool *cols, coord initial, int64_t *cluster, bool check_rows, bool *row_span, bool check_cols, bool *col_span)
+{
+    int n = l.n;
+    int64_t tmp_cluster = 0;
+
+    //sites are marked visited as soon as they are pushed, so each goes onto the stack once
+    stack_push(&stack, initial);
+    visited[initial.i][initial.j] = true;
+
+    //loop until no more elements in cluster
+    while (!stack_empty(&stack))
+    {
+        coord curr = stack_pop(&stack);
+        int i = curr.i;
+        int j = curr.j;
+        site here = l.sites[(size_t) i * n + j];
+
+        //increase cluster size
+        ++tmp_cluster;
+
+        //this cluster spans this row and col
+        rows[i] = true;
+        cols[j] = true;
+
+        //add each unvisited neighbour it has a bond to
+        #define VISIT_AT(ni, nj, has_bond) \
+        { \
+            coord next = {ni, nj}; \
+            site there = l.sites[(size_t) next.i * n + next.j]; \
+            (void) there; \
+            if ((has_bond) && !visited[next.i][next.j]) \
+            { \
+                stack_push(&stack, next); \
+                visited[next.i][next.j] = true; \
+            } \
+        }
+        #define VISIT_INTERIOR(di, dj, has_bond) VISIT_AT(i + (di), j + (dj), has_bond)
+        #define VISIT_EDGE(di, dj, has_bond) VISIT_AT(WRAP(i + (di), n), WRAP(j + (dj), n), has_bond)
+
+        //only the outermost ring of sites has neighbours which wrap around
+        if (i > 0 && i < n - 1 && j > 0 && j < n - 1)
+        {
+            NEIGHBOURS(VISIT_INTERIOR)
+        }
+        else
+        {
+            NEIGHBOURS(VISIT_EDGE)
+        }
+
+        #undef VISIT_AT
+        #undef VISIT_INTERIOR
+        #undef VISIT_EDGE
+    }
+
+    //send back cluster size, whether it spans
+    *cluster = tmp_cluster;
+    *row_span = check_rows ? spans(rows, n) : false;
+    *col_span = check_cols ? spans(cols, n) : false;
+}
+
+/**
+ * labels clusters by a depth first search from every unvisited site
+ */
+bool KERNEL(percolation_dfs)(lattice l, bool check_rows, bool check_cols, int64_t *cluster)
+{
+    bool **visited = search_init(l);
+    int64_t max_cluster = 0;
+    bool spans_rows = 0;
+    bool spans_cols = 0;
+
+    stack stack;
+    stack_init(&stack, (size_t) l.n * l.n);
+
+    bool *rows = malloc(l.n * sizeof(bool));
+    bool *cols = malloc(l.n * sizeof(bool));
+
+    //loop over every lattice site, start dfs from all unvisited
+    for (int i = 0; i < l.n; ++i)
+    {
+        for (int j = 0; j < l.n; ++j)
+        {
+            if ((*get_site(l, i, j) & OCCUPIED) && !visited[i][j])
+            {
+                //reset rows/cols
+                memset(rows, 0, l.n * sizeof(bool));
+                memset(cols, 0, l.n * sizeof(bool));
+
+                //calculate cluster data
+                int64_t this_cluster;
+                bool this_row_span, this_col_span;
+                coord curr = {i, j};
+                KERNEL(percolate_from)(l, stack, visited, rows, cols, curr, &this_cluster, check_rows, &this_row_span, check_cols, &this_col_span);
+
+                //update max/spanning info
+                max_cluster = MAX(max_cluster, this_cluster);
+                spans_rows |= this_row_span;
+                spans_cols |= this_col_span;
+            }
+        }
+    }
+
+    *cluster = max_cluster;
+    search_free(l, visited);
+    stack_free(&stack);
+    free(rows);
+    free(cols);
+
+    return (!check_rows || spans_rows) && (!check_cols || spans_cols);
+}
+
+/**
+ * labels clusters in a single raster scan, joining the labels of each site's neighbours
+ * which have already been scanned with union-find, then patches up the wraparound bonds
+ */
+bool KERNEL(percolation_uf)(lattice l, bool check_rows, bool check_cols, int64_t *cluster)
+{
+    int n = l.n;
+    int64_t max_cluster = 0;
+    bool spans_rows = 0;
+    bool spans_cols = 0;
+
+    //label of each site, 0 if unoccupied
+    int *label = malloc((size_t) n * n * sizeof(int));
+    if (label == NULL)
+    {
+        printf("failed to alloc\n");
+        exit(EXIT_FAILURE);
+    }
+
+    labels u;
+    labels_init(&u, n, n);
+
+    for (int i = 0; i < n; ++i)
+    {
+        for (int j = 0; j < n; ++j)
+        {
+            size_t k = (size_t) i * n + j;
+            coord curr = {i, j};
+            site here = l.sites[k];
+
+            if (!(here & OCCUPIED))
+            {
+                label[k] = 0;
+                continue;
+            }
+
+            //join the labels of the neighbours already scanned, ignoring wraparound for now
+            int a = 0;
+            #define JOIN_SCANNED(di, dj, has_bond) \
+            if ((di) < 0 || ((di) == 0 && (dj) < 0)) \
+            { \
+                int ni = i + (di), nj = j + (dj); \
+                if (ni >= 0 && nj >= 0 && nj < n) \
+                { \
+                    site there = l.sites[(size_t) ni * n + nj]; \
+                    (void) there; \
+                    if (has_bond) \
+                    { \
+                        int b = label[(size_t) ni * n + nj]; \
+                        a = a ? labels_union(&u, a, b, curr) : labels_add(&u, b, curr); \
+                    } \
+                } \
+            }
+            NEIGHBOURS(JOIN_SCANNED)
+            #undef JOIN_SCANNED
+
+            label[k] = a ? a : labels_new(&u, curr);
+        }
+    }
+
+    //join clusters across the edges, through the bonds the scan hadn't reached which wrap around
+    for (int x = 0; x < 2 * n; ++x)
+    {
+        int i = x < n ? x : n - 1;
+        int j = x < n ? n - 1 : x - n;
+        coord curr = {i, j};
+        site here = l.sites[(size_t) i * n + j];
+
+        #define JOIN_WRAPPED(di, dj, has_bond) \
+        if (((di) > 0 || ((di) == 0 && (dj) > 0)) && (i + (di) >= n || j + (dj) >= n)) \
+        { \
+            int ni = WRAP(i + (di), n), nj = WRAP(j + (dj), n); \
+            site there = l.sites[(size_t) ni * n + nj]; \
+            (void) there; \
+            if (has_bond) \
+            { \
+                labels_union(&u, label[(size_t) i * n + j], label[(size_t) ni * n + nj], curr); \
+            } \
+        }
+        NEIGHBOURS(JOIN_WRAPPED)
+        #undef JOIN_WRAPPED
+    }
+
+    //update max/spanning info from every canonical label
+    for (int a = 1; a < u.count; ++a)
+    {
+        if (u.parent[a] == a)
+        {
+            max_cluster = MAX(max_cluster, u.size[a]);
+            spans_rows |= u.rows[a].len == n;
+            spans_cols |= u.cols[a].len == n;
+        }
+    }
+
+    *cluster = max_cluster;
+    labels_free(&u);
+    free(label);
+
+    return (!check_rows || spans_rows) && (!check_cols || spans_cols);
+}
+
+/**
+ * decides whether any cluster spans every row (or every col, if along_cols) without labelling the
+ * lattice - only a cluster with a site in the first row (col) can, so a depth first search runs
+ * out from each of those in turn, stopping as soon as one has reached every row (col), or once
+ * they have all died out without one doing so
+ *
+ * rows (cols) are marked in `reached' with the number of the search reaching them, so it needs
+ * no clearing between searches
+ */
+bool KERNEL(spans_from_edge)(lattice l, bool along_cols, bool *visited, int *reached, stack *stack)
+{
+    int n = l.n;
+
+    for (int k = 0; k < n; ++k)
+    {
+        coord initial = {along_cols ? k : 0, along_cols ? 0 : k};
+        size_t at = (size_t) initial.i * n + initial.j;
+        if (!(l.sites[at] & OCCUPIED) || visited[at])
+        {
+            continue;
+        }
+
+        int search = k + 1;
+        int n_reached = 0;
+
+        stack_push(stack, initial);
+        visited[at] = true;
+
+        while (!stack_empty(stack))
+        {
+            coord curr = stack_pop(stack);
+            int i = curr.i;
+            int j = curr.j;
+            site here = l.sites[(size_t) i * n + j];
+
+            int line = along_cols ? j : i;
+            if (reached[line] != search)
+            {
+                reached[line] = search;
+                if (++n_reached == n)
+                {
+                    stack->size = 0;
+                    return true;
+                }
+            }
+
+            //the neighbours further down (right) are pushed last, so are explored first - a
+            //cluster which spans then heads straight for the rows (cols) it hasn't reached
+            #define VISIT_AT(ni, nj, has_bond) \
+            { \
+                coord next = {ni, nj}; \
+                site there = l.sites[(size_t) next.i * n + next.j]; \
+                (void) there; \
+                if ((has_bond) && !visited[(size_t) next.i * n + next.j]) \
+                { \
+                    stack_push(stack, next); \
+                    visited[(size_t) next.i * n + next.j] = true; \
+                } \
+            }
+            #define AHEAD(di, dj) (along_cols ? (dj) > 0 : (di) > 0)
+            #define VISIT_BEHIND(di, dj, has_bond) if (!AHEAD(di, dj)) VISIT_AT(WRAP(i + (di), n), WRAP(j + (dj), n), has_bond)
+            #define VISIT_AHEAD(di, dj, has_bond) if (AHEAD(di, dj)) VISIT_AT(WRAP(i + (di), n), WRAP(j + (dj), n), has_bond)
+
+            NEIGHBOURS(VISIT_BEHIND)
+            NEIGHBOURS(VISIT_AHEAD)
+
+            #undef VISIT_AT
+            #undef AHEAD
+            #undef VISIT_BEHIND
+            #undef VISIT_AHEAD
+        }
+    }
+
+    return false;
+}
+
+#undef KERNEL
@@ -1,33 +1,32 @@
+//for mmap
+#define _POSIX_C_SOURCE 200809L
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "lattice.h"
 
+#ifdef HAVE_AVX2
+#include <immintrin.h>
+#endif
+
 /**
- * returns a new empty square lattice of size n by n
+ * returns a new empty lattice of size n by n with the given geometry
  */
-lattice create_lattice(int n)
+lattice create_lattice(int n, geometry g)
 {
     lattice l;
     l.n = n;
-    l.sites = malloc(n * sizeof(site *));
+    l.mapped = 0;
+    l.geometry = g;
+    l.sites = calloc((size_t) n * n, sizeof(site));
     if (l.sites == NULL)
     {
         printf("failed to alloc\n");
         exit(EXIT_FAILURE);
     }
-    for (int i = 0; i < n; ++i)
-    {
-        l.sites[i] = calloc(n, sizeof(site));
-        if (l.sites[i] == NULL)
-        {
-            printf("failed to alloc\n");
-            exit(EXIT_FAILURE);
-        }
-        for (int j = 0; j < n; ++j)
-        {
-            l.sites[i][j].i = i;
-            l.sites[i][j].j = j;
-            l.sites[i][j].on_stack = false;
-        }
-    }
     return l;
 }
 
@@ -36,7 +35,7 @@ lattice create_lattice(int n)
  */
 site *get_site(lattice l, int i, int j)
 {
-  return l.sites[i] + j;
+  return l.sites + (size_t) i * l.n + j;
 }
 
 /**
@@ -44,82 +43,363 @@ site *get_site(lattice l, int i, int j)
  */
 void delete_lattice(lattice l)
 {
-    for (int i = 0; i < l.n; ++i)
+    if (l.mapped > 0)
+    {
+        munmap(l.sites - sizeof(lattice_header), l.mapped);
+    }
+    else
     {
-        free(l.sites[i]);
+        free(l.sites);
     }
-    free(l.sites);
 }
 
 /**
- * returns the direction opposite to the one given
+ * returns the coordinates of the neighbour of a given site in a given direction
  */
-int reverse(int dir)
+coord neighbour(lattice l, coord c, int dir)
 {
-    return (dir + N_DIRECTIONS / 2) % N_DIRECTIONS;
+    static const int i_offset[N_DIRECTIONS] = {-1, 0, 1, 0};
+    static const int j_offset[N_DIRECTIONS] = {0, 1, 0, -1};
+    coord n = {WRAP(c.i + i_offset[dir], l.n), WRAP(c.j + j_offset[dir], l.n)};
+    return n;
 }
 
 /**
- * returns a pointer to the neighbour of a given site in a given direction
+ * checks whether a site has a bond to its neighbour in a given direction - only
+ * E/S bonds are stored, so N/W bonds are looked up on the neighbour
  */
-site *neighbour(lattice l, site *s, int dir)
+bool bond(lattice l, coord c, int dir)
 {
-    int i_offset[N_DIRECTIONS] = {-1, 0, 1, 0};
-    int j_offset[N_DIRECTIONS] = {0, 1, 0, -1};
-    return &(l.sites[mod_p(s->i + i_offset[dir], l.n)][mod_p(s->j + j_offset[dir], l.n)]);
+    switch (dir)
+    {
+        case NORTH:
+            return *get_site(l, WRAP(c.i - 1, l.n), c.j) & BOND_SOUTH;
+        case EAST:
+            return *get_site(l, c.i, c.j) & BOND_EAST;
+        case SOUTH:
+            return *get_site(l, c.i, c.j) & BOND_SOUTH;
+        default:
+            return *get_site(l, c.i, WRAP(c.j - 1, l.n)) & BOND_EAST;
+    }
 }
 
+#ifdef HAVE_AVX2
 /**
- * seeds the sites of a lattice with probability p, and forms bonds appropriately
+ * mask_row for as many whole groups of 32 sites as fit in the row - returns how many were done
  */
-void seed_sites(lattice l, double p)
+__attribute__((target("avx2")))
+int mask_row_avx2(site *row, const uint32_t *r, int n, uint64_t threshold, site bit)
 {
-    for (int i = 0; i < l.n; ++i)
+    //p = 1 has a threshold past any 32 bit number, so is left to the scalar code
+    if (threshold > UINT32_MAX)
+    {
+        return 0;
+    }
+
+    //unsigned compare as a signed one, with the top bits flipped
+    const __m256i flip = _mm256_set1_epi32((int) 0x80000000u);
+    const __m256i limit = _mm256_set1_epi32((int) ((uint32_t) threshold ^ 0x80000000u));
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    const __m256i bits = _mm256_set1_epi8((char) bit);
+
+    int j = 0;
+    for (; j + 32 <= n; j += 32)
     {
-        for (int j = 0; j < l.n; ++j)
+        __m256i below[4];
+        for (int k = 0; k < 4; ++k)
         {
-            double curr = (double) rand() / RAND_MAX;
-            l.sites[i][j].occupied = curr < p;
+            __m256i x = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *) (r + j + 8 * k)), flip);
+            below[k] = _mm256_cmpgt_epi32(limit, x);
         }
+
+        //narrow the 32 bit masks to bytes - packing works within 128 bit halves, so put them back in order
+        __m256i mask = _mm256_packs_epi16(_mm256_packs_epi32(below[0], below[1]), _mm256_packs_epi32(below[2], below[3]));
+        mask = _mm256_permutevar8x32_epi32(mask, order);
+
+        __m256i sites = _mm256_loadu_si256((const __m256i *) (row + j));
+        _mm256_storeu_si256((__m256i *) (row + j), _mm256_or_si256(sites, _mm256_and_si256(mask, bits)));
     }
-    for (int i = 0; i < l.n; ++i)
+
+    return j;
+}
+
+/**
+ * site_bonds_row for whole groups of 32 sites which have their E neighbour in the same group
+ * or the next - returns how many were done
+ */
+__attribute__((target("avx2")))
+int site_bonds_row_avx2(site *row, const site *below, int n)
+{
+    const __m256i occupied = _mm256_set1_epi8(OCCUPIED);
+
+    int j = 0;
+    for (; j + 32 < n; j += 32)
     {
-        for (int j = 0; j < l.n; ++j)
+        __m256i here = _mm256_loadu_si256((const __m256i *) (row + j));
+        __m256i east = _mm256_loadu_si256((const __m256i *) (row + j + 1));
+        __m256i south = _mm256_loadu_si256((const __m256i *) (below + j));
+
+        //the OCCUPIED bit of both ends of a bond, doubled once to BOND_EAST or twice to BOND_SOUTH
+        __m256i e = _mm256_and_si256(_mm256_and_si256(here, east), occupied);
+        __m256i s = _mm256_and_si256(_mm256_and_si256(here, south), occupied);
+        e = _mm256_add_epi8(e, e);
+        s = _mm256_add_epi8(s, s);
+        s = _mm256_add_epi8(s, s);
+
+        _mm256_storeu_si256((__m256i *) (row + j), _mm256_or_si256(here, _mm256_or_si256(e, s)));
+    }
+
+    return j;
+}
+
+/**
+ * bond_sites_row for whole groups of 32 sites from the second site on, which have their W
+ * neighbour in the row without wrapping around - returns the first site not done
+ */
+__attribute__((target("avx2")))
+int bond_sites_row_avx2(site *row, const site *above, int n)
+{
+    const __m256i east = _mm256_set1_epi8(BOND_EAST);
+    const __m256i south = _mm256_set1_epi8(BOND_SOUTH);
+    const __m256i both = _mm256_set1_epi8(BOND_EAST | BOND_SOUTH);
+    const __m256i occupied = _mm256_set1_epi8(OCCUPIED);
+
+    int j = 1;
+    for (; j + 32 <= n; j += 32)
+    {
+        __m256i here = _mm256_loadu_si256((const __m256i *) (row + j));
+        __m256i west = _mm256_loadu_si256((const __m256i *) (row + j - 1));
+        __m256i north = _mm256_loadu_si256((const __m256i *) (above + j));
+
+        __m256i bonds = _mm256_or_si256(_mm256_and_si256(here, both),
+            _mm256_or_si256(_mm256_and_si256(west, east), _mm256_and_si256(north, south)));
+        __m256i none = _mm256_cmpeq_epi8(bonds, _mm256_setzero_si256());
+
+        _mm256_storeu_si256((__m256i *) (row + j), _mm256_or_si256(here, _mm256_andnot_si256(none, occupied)));
+    }
+
+    return j;
+}
+#endif
+
+/**
+ * sets `bit' on each site of a row whose random number is below the threshold
+ */
+void mask_row(site *row, const uint32_t *r, int n, uint64_t threshold, site bit)
+{
+    int start = 0;
+#ifdef HAVE_AVX2
+    if (use_avx2())
+    {
+        start = mask_row_avx2(row, r, n, threshold, bit);
+    }
+#endif
+
+    for (int j = start; j < n; ++j)
+    {
+        row[j] |= r[j] < threshold ? bit : 0;
+    }
+}
+
+/**
+ * draws which sites of row i are occupied with probability p, without any bonds
+ * - r is scratch space for n random numbers
+ */
+void sites_row(site *row, int i, int n, double p, uint64_t seed, uint32_t *r)
+{
+    rng_row(seed, STREAM_SITES, i, n, r);
+    memset(row, 0, n * sizeof(site));
+    mask_row(row, r, n, rng_threshold(p), OCCUPIED);
+}
+
+/**
+ * forms the E/S bonds of a row of occupied sites, given the row below it - a whole row
+ * at a time, as the OCCUPIED bit shifted up to the bond bits
+ */
+void site_bonds_row(site *row, const site *below, int n)
+{
+    int start = 0;
+#ifdef HAVE_AVX2
+    if (use_avx2())
+    {
+        start = site_bonds_row_avx2(row, below, n);
+    }
+#endif
+
+    for (int j = start; j < n; ++j)
+    {
+        //only E/S bonds are stored, N/W bonds belong to the neighbours
+        int east = j + 1 < n ? j + 1 : 0;
+        row[j] |= (row[j] & row[east] & OCCUPIED) << 1;
+        row[j] |= (row[j] & below[j] & OCCUPIED) << 2;
+    }
+}
+
+/**
+ * draws the E/S bonds of row i with probability p, without filling any sites
+ * - r is scratch space for n random numbers
+ */
+void bonds_row(site *row, int i, int n, double p, uint64_t seed, uint32_t *r)
+{
+    uint64_t threshold = rng_threshold(p);
+
+    memset(row, 0, n * sizeof(site));
+
+    rng_row(seed, STREAM_BONDS_EAST, i, n, r);
+    mask_row(row, r, n, threshold, BOND_EAST);
+
+    rng_row(seed, STREAM_BONDS_SOUTH, i, n, r);
+    mask_row(row, r, n, threshold, BOND_SOUTH);
+}
+
+/**
+ * fills the sites of a row which any bond leads to, given the row above it
+ */
+void bond_sites_row(site *row, const site *above, int n)
+{
+    //the first site's W neighbour wraps around to the end of the row
+    if ((row[0] & (BOND_EAST | BOND_SOUTH)) || (row[n - 1] & BOND_EAST) || (above[0] & BOND_SOUTH))
+    {
+        row[0] |= OCCUPIED;
+    }
+
+    int start = 1;
+#ifdef HAVE_AVX2
+    if (use_avx2())
+    {
+        start = bond_sites_row_avx2(row, above, n);
+    }
+#endif
+
+    for (int j = start; j < n; ++j)
+    {
+        if ((row[j] & (BOND_EAST | BOND_SOUTH)) || (row[j - 1] & BOND_EAST) || (above[j] & BOND_SOUTH))
         {
-            if (l.sites[i][j].occupied)
-            {
-                for (int k = 0; k < N_DIRECTIONS; ++k)
-                {
-                    l.sites[i][j].bond[k] = neighbour(l, get_site(l, i, j), k)->occupied;
-                }
-            }
+            row[j] |= OCCUPIED;
         }
     }
 }
 
 /**
- * seeds the bonds of a lattice with probability p, and fills the sites appropriately
+ * turns the bonds of row i of a square lattice into those of another geometry, given the row below it
+ * - a triangular lattice also has SE bonds between occupied sites, a honeycomb has no S bonds from odd sites
  */
-void seed_bonds(lattice l, double p)
+void site_geometry_row(site *row, const site *below, int i, int n, geometry g)
 {
-    for (int i = 0; i < l.n; ++i)
+    if (g == GEOMETRY_TRIANGULAR)
     {
-        for (int j = 0; j < l.n; ++j)
+        for (int j = 0; j < n; ++j)
         {
-            for (int k = 0; k < 2; ++k)
-            {
-                double curr = (double) rand() / RAND_MAX;
-                if (curr < p)
-                {
-                    l.sites[i][j].bond[k] = true;
-                    l.sites[i][j].occupied = true;
-                    site *n = neighbour(l, get_site(l, i, j), k);
-                    n->occupied = true;
-                    n->bond[reverse(k)] = true;
-                }
-            }
+            int east = j + 1 < n ? j + 1 : 0;
+            row[j] |= (row[j] & below[east] & OCCUPIED) ? BOND_DIAGONAL : 0;
         }
     }
+    else if (g == GEOMETRY_HONEYCOMB)
+    {
+        for (int j = (i + 1) % 2; j < n; j += 2)
+        {
+            row[j] &= ~BOND_SOUTH;
+        }
+    }
+}
+
+/**
+ * as site_geometry_row, for the bonds drawn for row i by bonds_row - SE bonds of a triangular
+ * lattice are drawn with probability p from their own stream
+ */
+void bond_geometry_row(site *row, int i, int n, double p, uint64_t seed, uint32_t *r, geometry g)
+{
+    if (g == GEOMETRY_TRIANGULAR)
+    {
+        rng_row(seed, STREAM_BONDS_DIAGONAL, i, n, r);
+        mask_row(row, r, n, rng_threshold(p), BOND_DIAGONAL);
+    }
+    else if (g == GEOMETRY_HONEYCOMB)
+    {
+        for (int j = (i + 1) % 2; j < n; j += 2)
+        {
+            row[j] &= ~BOND_SOUTH;
+        }
+    }
+}
+
+/**
+ * fills the sites of a row which a SE bond of a triangular lattice leads to or from,
+ * given the row above it - other bonds are the same as on a square lattice
+ */
+void geometry_sites_row(site *row, const site *above, int n, geometry g)
+{
+    if (g != GEOMETRY_TRIANGULAR)
+    {
+        return;
+    }
+
+    for (int j = 0; j < n; ++j)
+    {
+        int west = j > 0 ? j - 1 : n - 1;
+        if ((row[j] & BOND_DIAGONAL) || (above[west] & BOND_DIAGONAL))
+        {
+            row[j] |= OCCUPIED;
+        }
+    }
+}
+
+/**
+ * seeds the sites of a lattice with probability p, and forms bonds appropriately
+ *
+ * the random numbers come from a counter-based generator keyed by `seed`, so the
+ * lattice only depends on the seed, not on the order the rows are filled in
+ */
+void seed_sites(lattice l, double p, uint64_t seed)
+{
+    uint32_t *r = malloc(l.n * sizeof(uint32_t));
+    if (r == NULL)
+    {
+        printf("failed to alloc\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < l.n; ++i)
+    {
+        sites_row(get_site(l, i, 0), i, l.n, p, seed, r);
+    }
+    free(r);
+
+    for (int i = 0; i < l.n; ++i)
+    {
+        site_bonds_row(get_site(l, i, 0), get_site(l, WRAP(i + 1, l.n), 0), l.n);
+        site_geometry_row(get_site(l, i, 0), get_site(l, WRAP(i + 1, l.n), 0), i, l.n, l.geometry);
+    }
+}
+
+/**
+ * seeds the bonds of a lattice with probability p, and fills the sites appropriately
+ *
+ * as with the sites, the bonds only depend on `seed`
+ */
+void seed_bonds(lattice l, double p, uint64_t seed)
+{
+    uint32_t *r = malloc(l.n * sizeof(uint32_t));
+    if (r == NULL)
+    {
+        printf("failed to alloc\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < l.n; ++i)
+    {
+        bonds_row(get_site(l, i, 0), i, l.n, p, seed, r);
+        bond_geometry_row(get_site(l, i, 0), i, l.n, p, seed, r, l.geometry);
+    }
+    free(r);
+
+    //a site is filled if any bond leads to it - done as a second pass so that the row above has
+    //drawn its S bonds, even for the first row, whose row above is the last
+    for (int i = 0; i < l.n; ++i)
+    {
+        bond_sites_row(get_site(l, i, 0), get_site(l, WRAP(i - 1, l.n), 0), l.n);
+        geometry_sites_row(get_site(l, i, 0), get_site(l, WRAP(i - 1, l.n), 0), l.n, l.geometry);
+    }
 }
 
 /**
@@ -131,9 +411,74 @@ void print_lattice(lattice l)
   {
     for (int j = 0; j < l.n; ++j)
     {
-        site s = l.sites[i][j];
-        printf("{%d,%d,%d,%d} ", s.bond[0], s.bond[1], s.bond[2], s.bond[3]);
+        coord c = {i, j};
+        printf("{%d,%d,%d,%d} ", bond(l, c, NORTH), bond(l, c, EAST), bond(l, c, SOUTH), bond(l, c, WEST));
     }
     printf("\n");
   }
 }
+
+/**
+ * writes a lattice to a file, with a header recording how it was generated
+ */
+void save_lattice(lattice l, const char *path, char model, double p, uint64_t seed)
+{
+    lattice_header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, LATTICE_MAGIC, sizeof(h.magic));
+    h.version = LATTICE_VERSION;
+    h.n = l.n;
+    h.p = p;
+    h.seed = seed;
+    h.model = model;
+    h.geometry = (char) l.geometry;
+
+    FILE *f = fopen(path, "wb");
+    if (f == NULL
+        || fwrite(&h, sizeof(h), 1, f) != 1
+        || fwrite(l.sites, sizeof(site), (size_t) l.n * l.n, f) != (size_t) l.n * l.n
+        || fclose(f) != 0)
+    {
+        printf("failed to write lattice to %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * maps a lattice file written by save_lattice read-only into memory, so the sites are used
+ * straight from the file without a copy - the header is copied into h
+ */
+lattice load_lattice(const char *path, lattice_header *h)
+{
+    lattice l;
+
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(lattice_header))
+    {
+        printf("failed to read lattice from %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    l.mapped = st.st_size;
+    void *data = mmap(NULL, l.mapped, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        printf("failed to read lattice from %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    memcpy(h, data, sizeof(lattice_header));
+    if (memcmp(h->magic, LATTICE_MAGIC, sizeof(h->magic)) != 0 || h->version != LATTICE_VERSION
+        || h->n < 2 || h->geometry < 0 || h->geometry >= N_GEOMETRIES || l.mapped != sizeof(lattice_header) + (size_t) h->n * h->n)
+    {
+        printf("%s is not a lattice file\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    l.n = h->n;
+    l.geometry = h->geometry;
+    l.sites = (site *) data + sizeof(lattice_header);
+    return l;
+}
@@ -4,7 +4,9 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
 #include "util.h"
+#include "rng.h"
 
 #define N_DIRECTIONS  4
 #define NORTH         0
@@ -12,28 +14,73 @@
 #define SOUTH         2
 #define WEST          3
 
-//info on each lattice site
+//bits of a packed site - N/W bonds are the S/E bonds of the N/W neighbours
+#define OCCUPIED      0x1
+#define BOND_EAST     0x2
+#define BOND_SOUTH    0x4
+#define BOND_DIAGONAL 0x10 //SE bond of a triangular lattice
+
+#define LATTICE_MAGIC   "PERCLAT"
+#define LATTICE_VERSION 1
+
+//how the sites of a lattice are connected - every geometry is stored as a square array of sites
+typedef enum
+{
+    GEOMETRY_SQUARE, //4 neighbours, N/E/S/W
+    GEOMETRY_TRIANGULAR, //6 neighbours, the square ones plus SE/NW
+    GEOMETRY_HONEYCOMB, //3 neighbours as a brick wall, E/W plus S from sites with i + j even or N from odd ones
+    N_GEOMETRIES
+} geometry;
+
+//info on each lattice site, packed into one byte (see OCCUPIED, BOND_*)
+typedef unsigned char site;
+
+//coordinates of a site in the lattice
 typedef struct
 {
-    int i, j; //coordinates in lattice
-    bool occupied; //whether site is open or not
-    bool bond[N_DIRECTIONS]; //whether it has a bond to N E S W neighbours
-    bool on_stack; //make dfs more space efficient by only adding to stack once
-} site;
+    int i, j;
+} coord;
 
-//a square lattice holding sites
+//a lattice holding sites
 typedef struct
 {
-    site **sites; //a 2d square array of sites
+    site *sites; //a 2d square array of sites, stored row by row
     int n; //dimensions
+    size_t mapped; //bytes mapped in from a lattice file, or 0 if the sites were allocated
+    geometry geometry; //which of the sites are neighbours
 } lattice;
 
-lattice create_lattice(int n);
+//start of a lattice file, which is followed by the n * n sites row by row, one byte each as in memory
+//- fields are in the byte order of the machine which wrote it
+typedef struct
+{
+    char magic[8]; //LATTICE_MAGIC
+    uint32_t version; //LATTICE_VERSION
+    uint32_t n; //dimensions
+    double p; //seeding probability
+    uint64_t seed; //seed the lattice was generated from
+    char model; //'s' or 'b' for site/bond seeding
+    char geometry; //a geometry, 0 (square) in files from before there were others
+    char unused[6];
+} lattice_header;
+
+lattice create_lattice(int n, geometry g);
 site *get_site(lattice l, int i, int j);
 void delete_lattice(lattice l);
-site *neighbour(lattice l, site *s, int dir);
-void seed_sites(lattice l, double p);
-void seed_bonds(lattice l, double p);
+coord neighbour(lattice l, coord c, int dir);
+bool bond(lattice l, coord c, int dir);
+void mask_row(site *row, const uint32_t *r, int n, uint64_t threshold, site bit);
+void sites_row(site *row, int i, int n, double p, uint64_t seed, uint32_t *r);
+void site_bonds_row(site *row, const site *below, int n);
+void bonds_row(site *row, int i, int n, double p, uint64_t seed, uint32_t *r);
+void bond_sites_row(site *row, const site *above, int n);
+void site_geometry_row(site *row, const site *below, int i, int n, geometry g);
+void bond_geometry_row(site *row, int i, int n, double p, uint64_t seed, uint32_t *r, geometry g);
+void geometry_sites_row(site *row, const site *above, int n, geometry g);
+void seed_sites(lattice l, double p, uint64_t seed);
+void seed_bonds(lattice l, double p, uint64_t seed);
 void print_lattice(lattice l);
+void save_lattice(lattice l, const char *path, char model, double p, uint64_t seed);
+lattice load_lattice(const char *path, lattice_header *h);
 
 #endif
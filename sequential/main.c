@@ -1,17 +1,32 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
 #include <time.h>
 #include <omp.h>
 #include <string.h>
 #include "percolation.h"
 #include "lattice.h"
+#include "stream.h"
 
 /**
  * user has entered wrong program args - print help message and exit
  */
 void exit_incorrect_args()
 {
-    printf("usage: ./main lattice_size seed_prob seed_what percolation_kind\n");
+    printf("usage: ./main [options] lattice_size seed_prob seed_what percolation_kind\n");
+    printf("   or: ./main [options] --load file percolation_kind\n");
     printf("\twhere seed_what=s/b for site/bond seeding, percolation_kind=0/1/2 for row/col/both percolation checking\n");
+    printf("options:\n");
+    printf("\t--engine dfs/uf\tlabel clusters by depth first search (default) or union-find\n");
+    printf("\t--stream periodic/open\tgenerate and label the lattice one row at a time in O(n) memory, with the\n");
+    printf("\t\tfirst and last rows joined up or not (union-find only, columns always wrap around)\n");
+    printf("\t--geometry square/triangular/honeycomb\tlattice the sites are connected as (default: square), where\n");
+    printf("\t\ta honeycomb is a brick wall of the square sites, and needs an even lattice_size\n");
+    printf("\t--decide\tonly decide whether it percolates, searching out from the first row/col and stopping as\n");
+    printf("\t\tsoon as a cluster is found to span, without labelling every cluster or finding the max cluster\n");
+    printf("\t--save file\twrite the seeded lattice to a binary lattice file\n");
+    printf("\t--load file\tmap a lattice file written by --save instead of seeding one, which gives its size and seeding\n");
+    printf("\t--seed seed\tseed for the random lattice, the same seed always gives the same lattice (default: time)\n");
     printf("minimum lattice size is 2x2\n");
     exit(EXIT_FAILURE);
 }
@@ -21,37 +36,137 @@ void exit_incorrect_args()
  */
 int main(int argc, char *argv[])
 {
-    srand(time(NULL));
-
     --argc;
     ++argv;
 
-    if (argc < 4)
+    engine e = ENGINE_DFS;
+    uint64_t seed = time(NULL);
+    bool stream = false;
+    bool open = false;
+    bool decide = false;
+    char *save_file = NULL;
+    char *load_file = NULL;
+    geometry g = GEOMETRY_SQUARE;
+    const char *geometry_names[N_GEOMETRIES] = {"square", "triangular", "honeycomb"};
+
+    //pull out `--name value' options, leaving the positional args in order
+    int n_args = 0;
+    for (int k = 0; k < argc; ++k)
     {
-        exit_incorrect_args();
+        if (strncmp(argv[k], "--", 2) != 0)
+        {
+            argv[n_args++] = argv[k];
+            continue;
+        }
+
+        if (strcmp(argv[k], "--decide") == 0)
+        {
+            decide = true;
+            continue;
+        }
+
+        if (k + 1 == argc)
+        {
+            exit_incorrect_args();
+        }
+
+        char *name = argv[k] + 2;
+        char *value = argv[++k];
+
+        if (strcmp(name, "engine") == 0 && strcmp(value, "dfs") == 0)
+        {
+            e = ENGINE_DFS;
+        }
+        else if (strcmp(name, "engine") == 0 && strcmp(value, "uf") == 0)
+        {
+            e = ENGINE_UF;
+        }
+        else if (strcmp(name, "stream") == 0 && strcmp(value, "periodic") == 0)
+        {
+            stream = true;
+            open = false;
+        }
+        else if (strcmp(name, "stream") == 0 && strcmp(value, "open") == 0)
+        {
+            stream = true;
+            open = true;
+        }
+        else if (strcmp(name, "geometry") == 0)
+        {
+            for (g = 0; g < N_GEOMETRIES && strcmp(value, geometry_names[g]) != 0; ++g);
+            if (g == N_GEOMETRIES)
+            {
+                exit_incorrect_args();
+            }
+        }
+        else if (strcmp(name, "save") == 0)
+        {
+            save_file = value;
+        }
+        else if (strcmp(name, "load") == 0)
+        {
+            load_file = value;
+        }
+        else if (strcmp(name, "seed") == 0)
+        {
+            seed = strtoull(value, NULL, 10);
+        }
+        else
+        {
+            exit_incorrect_args();
+        }
     }
+    argc = n_args;
 
-    int n = atoi(argv[0]);
-    double p = atof(argv[1]);
-    char *seed_type = argv[2];
-    int percolation_type = atoi(argv[3]);
+    lattice l;
+    int n, percolation_type;
+    double p;
+    char *seed_type;
+    char model[2] = "";
 
-    if (n <= 1 || p < 0 || p > 1 || percolation_type < 0 || percolation_type > 2)
+    if (load_file != NULL)
     {
-        exit_incorrect_args();
+        //a loaded lattice brings its own size, seeding and seed with it
+        if (argc < 1)
+        {
+            exit_incorrect_args();
+        }
+
+        lattice_header h;
+        l = load_lattice(load_file, &h);
+        n = l.n;
+        p = h.p;
+        model[0] = h.model;
+        seed_type = model;
+        seed = h.seed;
+        g = l.geometry;
+        percolation_type = atoi(argv[0]);
     }
+    else
+    {
+        if (argc < 4)
+        {
+            exit_incorrect_args();
+        }
 
-    lattice l = create_lattice(n);
+        n = atoi(argv[0]);
+        p = atof(argv[1]);
+        seed_type = argv[2];
+        percolation_type = atoi(argv[3]);
+    }
 
-    if (strcmp(seed_type, "s") == 0)
+    if (n <= 1 || p < 0 || p > 1 || percolation_type < 0 || percolation_type > 2)
     {
-        seed_sites(l, p);
+        exit_incorrect_args();
     }
-    else if (strcmp(seed_type, "b") == 0)
+
+    if (strcmp(seed_type, "s") != 0 && strcmp(seed_type, "b") != 0)
     {
-        seed_bonds(l, p);
+        exit_incorrect_args();
     }
-    else
+
+    //a brick wall only joins up across the N/S edge if it has an even number of rows
+    if (g == GEOMETRY_HONEYCOMB && n % 2 != 0)
     {
         exit_incorrect_args();
     }
@@ -59,12 +174,74 @@ int main(int argc, char *argv[])
     bool row_check = percolation_type == 0 || percolation_type == 2;
     bool col_check = percolation_type == 1 || percolation_type == 2;
 
-    int max_cluster;
+    //never holds the whole lattice, so the rows are generated (or read) as they are labelled
+    if (stream)
+    {
+        if (save_file != NULL || g != GEOMETRY_SQUARE || decide)
+        {
+            exit_incorrect_args();
+        }
+
+        row_source s;
+        int64_t max_cluster;
+
+        double time = omp_get_wtime();
+        if (load_file != NULL)
+        {
+            source_load(&s, l);
+        }
+        else
+        {
+            source_init(&s, n, p, strcmp(seed_type, "b") == 0, seed);
+        }
+        bool success = percolation_stream(&s, open, row_check, col_check, &max_cluster);
+        source_free(&s);
+
+        printf("percolates=%s,max_cluster=%" PRId64 ",seed=%" PRIu64 ",time=%.4fs\n", success ? "true" : "false", max_cluster, seed, omp_get_wtime() - time);
+
+        if (load_file != NULL)
+        {
+            delete_lattice(l);
+        }
+        return EXIT_SUCCESS;
+    }
+
+    if (load_file == NULL)
+    {
+        l = create_lattice(n, g);
+
+        if (strcmp(seed_type, "s") == 0)
+        {
+            seed_sites(l, p, seed);
+        }
+        else
+        {
+            seed_bonds(l, p, seed);
+        }
+    }
+
+    if (save_file != NULL)
+    {
+        save_lattice(l, save_file, seed_type[0], p, seed);
+    }
+
+    if (decide)
+    {
+        double time = omp_get_wtime();
+        bool success = percolation_decide(l, row_check, col_check);
+
+        printf("percolates=%s,seed=%" PRIu64 ",time=%.4fs\n", success ? "true" : "false", seed, omp_get_wtime() - time);
+
+        delete_lattice(l);
+        return EXIT_SUCCESS;
+    }
+
+    int64_t max_cluster;
 
     double time = omp_get_wtime();
-    bool success = percolation(l, row_check, col_check, &max_cluster);
+    bool success = percolation(l, row_check, col_check, e, &max_cluster);
 
-    printf("percolates=%s,max_cluster=%d,time=%.4fs\n", success ? "true" : "false", max_cluster, omp_get_wtime() - time);
+    printf("percolates=%s,max_cluster=%" PRId64 ",seed=%" PRIu64 ",time=%.4fs\n", success ? "true" : "false", max_cluster, seed, omp_get_wtime() - time);
 
     delete_lattice(l);
 
@@ -1,5 +1,7 @@
 #include "percolation.h"
 #include "stack.h"
+#include "unionfind.h"
+#include "geometry.h"
 
 /**
  * n by n visited array for dfs
@@ -41,103 +43,94 @@ bool spans(bool *array, int n)
     return true;
 }
 
+//kernels for each geometry, e.g. percolation_dfs_square and percolation_uf_square
+#define GEOMETRY square
+#define NEIGHBOURS SQUARE_NEIGHBOURS
+#include "kernels.h"
+#undef GEOMETRY
+#undef NEIGHBOURS
+
+#define GEOMETRY triangular
+#define NEIGHBOURS TRIANGULAR_NEIGHBOURS
+#include "kernels.h"
+#undef GEOMETRY
+#undef NEIGHBOURS
+
+#define GEOMETRY honeycomb
+#define NEIGHBOURS HONEYCOMB_NEIGHBOURS
+#include "kernels.h"
+#undef GEOMETRY
+#undef NEIGHBOURS
+
 /**
- * performs dfs from an unvisited site to find full cluster
+ * calculates whether a lattice percolates (row, col, both), and the largest cluster,
+ * with the kernel for the lattice's geometry
  */
-void percolate_from(lattice l, stack stack, bool **visited, bool *rows, bool *cols, site *initial, int *cluster, bool check_rows, bool *row_span, bool check_cols, bool *col_span)
+bool percolation(lattice l, bool check_rows, bool check_cols, engine e, int64_t *cluster)
 {
-    int tmp_cluster = 0;
-
-    stack_push(&stack, initial);
-
-    //loop until no more elements in cluster
-    while (!stack_empty(&stack))
+    switch (l.geometry)
     {
-        site *curr = stack_pop(&stack);
-        int i = curr->i;
-        int j = curr->j;
-
-        if (visited[i][j])
-        {
-            continue;
-        }
-
-        visited[i][j] = true;
-
-        //increase cluster size
-        ++tmp_cluster;
-
-        //this cluster spans this row and col
-        rows[i] = true;
-        cols[j] = true;
-
-        //loop over potential neighbours
-        for (int k = 0; k < N_DIRECTIONS; ++k)
-        {
-            if (curr->bond[k])
-            {
-                site *n = neighbour(l, curr, k);
-                if (!visited[n->i][n->j] && !n->on_stack)
-                {
-                    //add to stack if unvisited neighbour
-                    stack_push(&stack, n);
-                    n->on_stack = true;
-                }
-            }
-        }
+        case GEOMETRY_TRIANGULAR:
+            return e == ENGINE_UF ? percolation_uf_triangular(l, check_rows, check_cols, cluster)
+                : percolation_dfs_triangular(l, check_rows, check_cols, cluster);
+        case GEOMETRY_HONEYCOMB:
+            return e == ENGINE_UF ? percolation_uf_honeycomb(l, check_rows, check_cols, cluster)
+                : percolation_dfs_honeycomb(l, check_rows, check_cols, cluster);
+        default:
+            return e == ENGINE_UF ? percolation_uf_square(l, check_rows, check_cols, cluster)
+                : percolation_dfs_square(l, check_rows, check_cols, cluster);
     }
-
-    //send back cluster size, whether it spans
-    *cluster = tmp_cluster;
-    *row_span = check_rows ? spans(rows, l.n) : false;
-    *col_span = check_cols ? spans(cols, l.n) : false;
 }
 
 /**
- * calculates whether a lattice percolates (row, col, both), and the largest cluster
+ * decides whether a lattice percolates (row, col, both) without labelling every cluster or finding
+ * the largest, by searching out from the first row (col) with the kernel for the lattice's geometry
  */
-bool percolation(lattice l, bool check_rows, bool check_cols, int *cluster)
+bool percolation_decide(lattice l, bool check_rows, bool check_cols)
 {
-    bool **visited = search_init(l);
-    int max_cluster = 0;
-    bool spans_rows = 0;
-    bool spans_cols = 0;
+    bool *visited = calloc((size_t) l.n * l.n, sizeof(bool));
+    int *reached = calloc(l.n, sizeof(int));
+    if (visited == NULL || reached == NULL)
+    {
+        printf("failed to alloc\n");
+        exit(EXIT_FAILURE);
+    }
 
+    //grows with the search, rather than holding room for the whole lattice up front
     stack stack;
-    stack_init(&stack, l.n * l.n);
+    stack_init(&stack, l.n);
 
-    bool *rows = malloc(l.n * sizeof(bool));
-    bool *cols = malloc(l.n * sizeof(bool));
-
-    //loop over every lattice site, start dfs from all unvisited
-    for (int i = 0; i < l.n; ++i)
+    bool success = true;
+    for (int along_cols = 0; along_cols <= 1 && success; ++along_cols)
     {
-        for (int j = 0; j < l.n; ++j)
+        if (!(along_cols ? check_cols : check_rows))
+        {
+            continue;
+        }
+
+        //a cluster already searched from the first row may still span the cols
+        if (along_cols && check_rows)
         {
-            site *curr = get_site(l, i, j);
-            if (curr->occupied && !visited[i][j])
-            {
-                //reset rows/cols
-                memset(rows, 0, l.n * sizeof(bool));
-                memset(cols, 0, l.n * sizeof(bool));
+            memset(visited, 0, (size_t) l.n * l.n * sizeof(bool));
+            memset(reached, 0, l.n * sizeof(int));
+        }
 
-                //calculate cluster data
-                int this_cluster;
-                bool this_row_span, this_col_span;
-                percolate_from(l, stack, visited, rows, cols, get_site(l, i, j), &this_cluster, check_rows, &this_row_span, check_cols, &this_col_span);
-                
-                //update max/spanning info
-                max_cluster = MAX(max_cluster, this_cluster);
-                spans_rows |= this_row_span;
-                spans_cols |= this_col_span;
-            }
+        switch (l.geometry)
+        {
+            case GEOMETRY_TRIANGULAR:
+                success = spans_from_edge_triangular(l, along_cols, visited, reached, &stack);
+                break;
+            case GEOMETRY_HONEYCOMB:
+                success = spans_from_edge_honeycomb(l, along_cols, visited, reached, &stack);
+                break;
+            default:
+                success = spans_from_edge_square(l, along_cols, visited, reached, &stack);
         }
     }
 
-    *cluster = max_cluster;
-    search_free(l, visited);
-    free(rows);
-    free(cols);
+    free(visited);
+    free(reached);
+    stack_free(&stack);
 
-    return (!check_rows || spans_rows) && (!check_cols || spans_cols);
+    return success;
 }
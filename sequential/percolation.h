@@ -4,6 +4,14 @@
 #include <string.h>
 #include "lattice.h"
 
-bool percolation(lattice l, bool row_check, bool col_check, int *cluster);
+//algorithm used to label the clusters of the lattice
+typedef enum
+{
+    ENGINE_DFS, //depth first search out from each unvisited site
+    ENGINE_UF //raster scan joining labels with union-find (Hoshen-Kopelman)
+} engine;
+
+bool percolation(lattice l, bool row_check, bool col_check, engine e, int64_t *cluster);
+bool percolation_decide(lattice l, bool check_rows, bool check_cols);
 
 #endif
@@ -0,0 +1,159 @@
+#include "rng.h"
+
+#ifdef HAVE_AVX2
+#include <immintrin.h>
+#endif
+
+#define PHILOX_M0  0xD2511F53u
+#define PHILOX_M1  0xCD9E8D57u
+#define PHILOX_W0  0x9E3779B9u
+#define PHILOX_W1  0xBB67AE85u
+#define PHILOX_ROUNDS  10
+
+//whether SIMD kernels may be used - can be turned off to compare against the scalar code
+bool simd_enabled = true;
+
+/**
+ * checks whether to use the AVX2 kernels
+ */
+bool use_avx2(void)
+{
+#ifdef HAVE_AVX2
+    return simd_enabled && __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
+
+/**
+ * Philox4x32-10 counter-based generator (Salmon et al., SC'11): maps a 128 bit counter
+ * and 64 bit key to 128 random bits, so any random number can be computed on its own,
+ * in any order, on any thread
+ */
+void philox(uint64_t seed, const uint32_t ctr[4], uint32_t out[4])
+{
+    uint32_t k0 = (uint32_t) seed;
+    uint32_t k1 = (uint32_t) (seed >> 32);
+    uint32_t c0 = ctr[0], c1 = ctr[1], c2 = ctr[2], c3 = ctr[3];
+
+    for (int r = 0; r < PHILOX_ROUNDS; ++r)
+    {
+        uint64_t p0 = (uint64_t) PHILOX_M0 * c0;
+        uint64_t p1 = (uint64_t) PHILOX_M1 * c2;
+
+        c0 = (uint32_t) (p1 >> 32) ^ c1 ^ k0;
+        c1 = (uint32_t) p1;
+        c2 = (uint32_t) (p0 >> 32) ^ c3 ^ k1;
+        c3 = (uint32_t) p0;
+
+        k0 += PHILOX_W0;
+        k1 += PHILOX_W1;
+    }
+
+    out[0] = c0;
+    out[1] = c1;
+    out[2] = c2;
+    out[3] = c3;
+}
+
+#ifdef HAVE_AVX2
+/**
+ * rng_row for as many whole groups of 32 sites as fit in the row, running 8 generators at
+ * once with one per 32 bit lane - returns how many sites were filled
+ */
+__attribute__((target("avx2")))
+int rng_row_avx2(uint64_t seed, uint32_t stream, int i, int n, uint32_t *out)
+{
+    const __m256i m0 = _mm256_set1_epi32((int) PHILOX_M0);
+    const __m256i m1 = _mm256_set1_epi32((int) PHILOX_M1);
+
+    int j = 0;
+    for (; j + 32 <= n; j += 32)
+    {
+        //counters of the 8 blocks of 4 sites, one per lane
+        __m256i c0 = _mm256_add_epi32(_mm256_set1_epi32(j / 4), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+        __m256i c1 = _mm256_set1_epi32(i);
+        __m256i c2 = _mm256_set1_epi32((int) stream);
+        __m256i c3 = _mm256_setzero_si256();
+
+        uint32_t k0 = (uint32_t) seed;
+        uint32_t k1 = (uint32_t) (seed >> 32);
+
+        for (int r = 0; r < PHILOX_ROUNDS; ++r)
+        {
+            //32x32 -> 64 bit products of the even lanes, then of the odd lanes shifted down
+            __m256i even0 = _mm256_mul_epu32(c0, m0);
+            __m256i odd0 = _mm256_mul_epu32(_mm256_srli_epi64(c0, 32), m0);
+            __m256i even1 = _mm256_mul_epu32(c2, m1);
+            __m256i odd1 = _mm256_mul_epu32(_mm256_srli_epi64(c2, 32), m1);
+
+            __m256i lo0 = _mm256_blend_epi32(even0, _mm256_slli_epi64(odd0, 32), 0xAA);
+            __m256i hi0 = _mm256_blend_epi32(_mm256_srli_epi64(even0, 32), odd0, 0xAA);
+            __m256i lo1 = _mm256_blend_epi32(even1, _mm256_slli_epi64(odd1, 32), 0xAA);
+            __m256i hi1 = _mm256_blend_epi32(_mm256_srli_epi64(even1, 32), odd1, 0xAA);
+
+            c0 = _mm256_xor_si256(_mm256_xor_si256(hi1, c1), _mm256_set1_epi32((int) k0));
+            c1 = lo1;
+            c2 = _mm256_xor_si256(_mm256_xor_si256(hi0, c3), _mm256_set1_epi32((int) k1));
+            c3 = lo0;
+
+            k0 += PHILOX_W0;
+            k1 += PHILOX_W1;
+        }
+
+        //transpose so the 4 words of each block are next to each other
+        __m256i t0 = _mm256_unpacklo_epi32(c0, c1);
+        __m256i t1 = _mm256_unpackhi_epi32(c0, c1);
+        __m256i t2 = _mm256_unpacklo_epi32(c2, c3);
+        __m256i t3 = _mm256_unpackhi_epi32(c2, c3);
+
+        __m256i b04 = _mm256_unpacklo_epi64(t0, t2);
+        __m256i b15 = _mm256_unpackhi_epi64(t0, t2);
+        __m256i b26 = _mm256_unpacklo_epi64(t1, t3);
+        __m256i b37 = _mm256_unpackhi_epi64(t1, t3);
+
+        _mm256_storeu_si256((__m256i *) (out + j), _mm256_permute2x128_si256(b04, b15, 0x20));
+        _mm256_storeu_si256((__m256i *) (out + j + 8), _mm256_permute2x128_si256(b26, b37, 0x20));
+        _mm256_storeu_si256((__m256i *) (out + j + 16), _mm256_permute2x128_si256(b04, b15, 0x31));
+        _mm256_storeu_si256((__m256i *) (out + j + 24), _mm256_permute2x128_si256(b26, b37, 0x31));
+    }
+
+    return j;
+}
+#endif
+
+/**
+ * fills `out` with the n random numbers of a given stream for row i of the lattice -
+ * each call to the generator gives the numbers for 4 consecutive sites of the row
+ */
+void rng_row(uint64_t seed, uint32_t stream, int i, int n, uint32_t *out)
+{
+    int start = 0;
+#ifdef HAVE_AVX2
+    if (use_avx2())
+    {
+        start = rng_row_avx2(seed, stream, i, n, out);
+    }
+#endif
+
+    for (int j = start; j < n; j += 4)
+    {
+        uint32_t ctr[4] = {(uint32_t) j / 4, (uint32_t) i, stream, 0};
+        uint32_t block[4];
+        philox(seed, ctr, block);
+
+        for (int k = 0; k < 4 && j + k < n; ++k)
+        {
+            out[j + k] = block[k];
+        }
+    }
+}
+
+/**
+ * the fixed point threshold for probability p: a random number r is below p
+ * if r < threshold - exact for p = 0 and p = 1
+ */
+uint64_t rng_threshold(double p)
+{
+    return (uint64_t) (p * 4294967296.0);
+}
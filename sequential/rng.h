@@ -0,0 +1,27 @@
+#ifndef __RNG_H
+#define __RNG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//AVX2 kernels are built for x86 with GCC-style target attributes, and used when the CPU has AVX2
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_AVX2 1
+#endif
+
+//independent streams of random numbers drawn for each site
+#define STREAM_SITES        0
+#define STREAM_BONDS_EAST   1
+#define STREAM_BONDS_SOUTH  2
+
+//SE bonds of a triangular lattice
+#define STREAM_BONDS_DIAGONAL 5
+
+extern bool simd_enabled;
+
+bool use_avx2(void);
+void philox(uint64_t seed, const uint32_t ctr[4], uint32_t out[4]);
+void rng_row(uint64_t seed, uint32_t stream, int i, int n, uint32_t *out);
+uint64_t rng_threshold(double p);
+
+#endif
@@ -2,16 +2,18 @@
 #define __STACK_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include "lattice.h"
 
 typedef struct {
-    site **data;
-    int size;
+    coord *data;
+    size_t size;
+    size_t max; //elements there is room for, doubled whenever a push needs more
 } stack;
 
-void stack_init(stack *s, int max);
-void stack_push(stack *s, site *d);
-site *stack_pop(stack *s);
+void stack_init(stack *s, size_t max);
+void stack_push(stack *s, coord d);
+coord stack_pop(stack *s);
 bool stack_empty(stack *s);
 void stack_free(stack *s);
 
@@ -0,0 +1,264 @@
+#include "stream.h"
+
+/**
+ * sets up a source for the rows of an n by n lattice seeded with probability p
+ */
+void source_init(row_source *s, int n, double p, bool bonds, uint64_t seed)
+{
+    s->n = n;
+    s->p = p;
+    s->bonds = bonds;
+    s->seed = seed;
+    s->sites = NULL;
+    s->i = 0;
+
+    s->row = malloc(n * sizeof(site));
+    s->other = malloc(n * sizeof(site));
+    s->r = malloc(n * sizeof(uint32_t));
+    if (s->row == NULL || s->other == NULL || s->r == NULL)
+    {
+        printf("failed to alloc\n");
+        exit(EXIT_FAILURE);
+    }
+
+    //the first row needs the occupancy of itself, or the bonds of the last row above it
+    if (bonds)
+    {
+        bonds_row(s->other, n - 1, n, p, seed, s->r);
+    }
+    else
+    {
+        sites_row(s->other, 0, n, p, seed, s->r);
+    }
+}
+
+/**
+ * sets up a source for the rows of an existing lattice, which are handed out in place
+ */
+void source_load(row_source *s, lattice l)
+{
+    s->n = l.n;
+    s->sites = l.sites;
+    s->i = 0;
+    s->row = NULL;
+    s->other = NULL;
+    s->r = NULL;
+}
+
+/**
+ * generates the next row of the lattice - the returned row is only valid until the next call
+ */
+site *source_next(row_source *s)
+{
+    int n = s->n;
+    int i = s->i++;
+
+    if (s->sites != NULL)
+    {
+        return s->sites + (size_t) i * n;
+    }
+
+    if (s->bonds)
+    {
+        //bonds of this row, then fill sites from them and the bonds of the row above
+        bonds_row(s->row, i, n, s->p, s->seed, s->r);
+        bond_sites_row(s->row, s->other, n);
+        memcpy(s->other, s->row, n * sizeof(site));
+    }
+    else
+    {
+        //occupancy of this row was drawn last time, draw the row below to form the bonds
+        memcpy(s->row, s->other, n * sizeof(site));
+        sites_row(s->other, (i + 1) % n, n, s->p, s->seed, s->r);
+        site_bonds_row(s->row, s->other, n);
+    }
+
+    return s->row;
+}
+
+/**
+ * cleans up memory held by a row source
+ */
+void source_free(row_source *s)
+{
+    free(s->row);
+    free(s->other);
+    free(s->r);
+}
+
+/**
+ * moves the clusters still reachable from the label rows into a fresh set of labels, relabelling
+ * the rows to match - every other cluster is complete, so is checked for max/spanning and dropped
+ * remap is scratch space with a zeroed entry for each label in u
+ */
+void compact_labels(labels *u, labels *v, int *remap, int **label_rows, int n_rows, int n,
+    int64_t *max_cluster, bool *spans_rows, bool *spans_cols)
+{
+    v->count = 1;
+
+    for (int k = 0; k < n_rows; ++k)
+    {
+        int *label = label_rows[k];
+        for (int j = 0; j < n; ++j)
+        {
+            if (label[j])
+            {
+                int a = labels_find(u, label[j]);
+                if (remap[a] == 0)
+                {
+                    remap[a] = labels_copy(v, u, a);
+                }
+                label[j] = remap[a];
+            }
+        }
+    }
+
+    for (int a = 1; a < u->count; ++a)
+    {
+        if (u->parent[a] == a && remap[a] == 0)
+        {
+            *max_cluster = MAX(*max_cluster, u->size[a]);
+            *spans_rows |= u->rows[a].len == n;
+            *spans_cols |= u->cols[a].len == n;
+        }
+        remap[a] = 0;
+    }
+}
+
+/**
+ * labels the clusters of a lattice one row at a time (Hoshen-Kopelman), keeping only the labels of
+ * the last row - plus the first row, to join across the N/S edge unless `open' - so memory is O(n)
+ *
+ * the E/W edge always wraps around - if `open', bonds from the last row back to the first are ignored
+ * returns whether the lattice percolates, and the size of the max cluster
+ */
+bool percolation_stream(row_source *s, bool open, bool row_check, bool col_check, int64_t *cluster)
+{
+    int n = s->n;
+    int64_t max_cluster = 0;
+    bool spans_rows = 0;
+    bool spans_cols = 0;
+
+    //labels of the sites in the row above, this row, and the first row
+    int *above = calloc(n, sizeof(int));
+    int *current = calloc(n, sizeof(int));
+    int *first = calloc(n, sizeof(int));
+
+    //bonds of the row above
+    site *prev = calloc(n, sizeof(site));
+
+    //labels in use, and a fresh set to move the live ones into after each row
+    labels u, v;
+    labels_init(&u, n, 2 * n);
+    labels_init(&v, n, 2 * n);
+    int remap_size = u.max;
+    int *remap = calloc(remap_size, sizeof(int));
+
+    if (above == NULL || current == NULL || first == NULL || prev == NULL || remap == NULL)
+    {
+        printf("failed to alloc\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < n; ++i)
+    {
+        site *row = source_next(s);
+
+        for (int j = 0; j < n; ++j)
+        {
+            coord curr = {i, j};
+
+            if (!(row[j] & OCCUPIED))
+            {
+                current[j] = 0;
+                continue;
+            }
+
+            //labels of the neighbours already scanned, ignoring wraparound for now
+            int up = i > 0 && (prev[j] & BOND_SOUTH) ? above[j] : 0;
+            int left = j > 0 && (row[j - 1] & BOND_EAST) ? current[j - 1] : 0;
+
+            if (up && left)
+            {
+                current[j] = labels_union(&u, labels_add(&u, up, curr), left, curr);
+            }
+            else if (up || left)
+            {
+                current[j] = labels_add(&u, up ? up : left, curr);
+            }
+            else
+            {
+                current[j] = labels_new(&u, curr);
+            }
+        }
+
+        //join clusters across the E/W edge
+        coord last = {i, n - 1};
+        if (row[n - 1] & BOND_EAST)
+        {
+            labels_union(&u, current[n - 1], current[0], last);
+        }
+
+        if (i == 0 && !open)
+        {
+            memcpy(first, current, n * sizeof(int));
+        }
+
+        //drop clusters which can't grow any more - the first row is kept to join across the N/S edge
+        int *label_rows[2] = {current, first};
+        if (remap_size < u.max)
+        {
+            remap = realloc(remap, u.max * sizeof(int));
+            if (remap == NULL)
+            {
+                printf("failed to alloc\n");
+                exit(EXIT_FAILURE);
+            }
+            memset(remap + remap_size, 0, (u.max - remap_size) * sizeof(int));
+            remap_size = u.max;
+        }
+        compact_labels(&u, &v, remap, label_rows, open ? 1 : 2, n, &max_cluster, &spans_rows, &spans_cols);
+
+        labels t = u;
+        u = v;
+        v = t;
+
+        int *swap = above;
+        above = current;
+        current = swap;
+        memcpy(prev, row, n * sizeof(site));
+    }
+
+    //join clusters across the N/S edge
+    for (int j = 0; j < n && !open; ++j)
+    {
+        coord curr = {n - 1, j};
+        if (prev[j] & BOND_SOUTH)
+        {
+            labels_union(&u, above[j], first[j], curr);
+        }
+    }
+
+    //update max/spanning info from every cluster left
+    for (int a = 1; a < u.count; ++a)
+    {
+        if (u.parent[a] == a)
+        {
+            max_cluster = MAX(max_cluster, u.size[a]);
+            spans_rows |= u.rows[a].len == n;
+            spans_cols |= u.cols[a].len == n;
+        }
+    }
+
+    *cluster = max_cluster;
+
+    labels_free(&u);
+    labels_free(&v);
+    free(remap);
+    free(above);
+    free(current);
+    free(first);
+    free(prev);
+
+    return (!row_check || spans_rows) && (!col_check || spans_cols);
+}
@@ -0,0 +1,33 @@
+#ifndef __STREAM_H
+#define __STREAM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "lattice.h"
+#include "unionfind.h"
+
+//rows of a random lattice generated one at a time, exactly as seed_sites/seed_bonds would fill them,
+//or read one at a time from a loaded lattice
+typedef struct
+{
+    site *sites; //rows of a loaded lattice, or NULL to generate them
+
+    int n; //dimensions
+    double p; //seeding probability
+    bool bonds; //whether bonds (rather than sites) are seeded
+    uint64_t seed;
+
+    int i; //the next row to hand out
+    site *row; //the row handed out last
+    site *other; //occupancy of the row below (site seeding) or bonds of the row above (bond seeding)
+    uint32_t *r; //random numbers for one row
+} row_source;
+
+void source_init(row_source *s, int n, double p, bool bonds, uint64_t seed);
+void source_load(row_source *s, lattice l);
+site *source_next(row_source *s);
+void source_free(row_source *s);
+bool percolation_stream(row_source *s, bool open, bool row_check, bool col_check, int64_t *cluster);
+
+#endif
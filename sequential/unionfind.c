@@ -0,0 +1,143 @@
+#include "unionfind.h"
+
+/**
+ * grows the label arrays to hold at least `max` labels
+ */
+void labels_grow(labels *u, int max)
+{
+    u->max = max;
+    u->parent = realloc(u->parent, max * sizeof(int));
+    u->size = realloc(u->size, max * sizeof(int64_t));
+    u->rows = realloc(u->rows, max * sizeof(span));
+    u->cols = realloc(u->cols, max * sizeof(span));
+    if (u->parent == NULL || u->size == NULL || u->rows == NULL || u->cols == NULL)
+    {
+        printf("failed to alloc\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * initialises an empty set of labels for an n by n lattice, with room for `max` labels to begin with
+ */
+void labels_init(labels *u, int n, int max)
+{
+    u->parent = NULL;
+    u->size = NULL;
+    u->rows = NULL;
+    u->cols = NULL;
+    u->n = n;
+    labels_grow(u, MAX(max, 2));
+
+    //label 0 is never handed out
+    u->count = 1;
+}
+
+/**
+ * cleans up memory held by a set of labels
+ */
+void labels_free(labels *u)
+{
+    free(u->parent);
+    free(u->size);
+    free(u->rows);
+    free(u->cols);
+}
+
+/**
+ * hands out a new label for a cluster holding the single site c
+ */
+int labels_new(labels *u, coord c)
+{
+    if (u->count == u->max)
+    {
+        labels_grow(u, 2 * u->max);
+    }
+
+    int a = u->count++;
+    u->parent[a] = a;
+    u->size[a] = 1;
+    u->rows[a] = span_point(c.i);
+    u->cols[a] = span_point(c.j);
+    return a;
+}
+
+/**
+ * returns the canonical label of the cluster that label a belongs to, compressing the path on the way
+ */
+int labels_find(labels *u, int a)
+{
+    int root = a;
+    while (u->parent[root] != root)
+    {
+        root = u->parent[root];
+    }
+
+    //point everything on the path straight at the root
+    while (u->parent[a] != root)
+    {
+        int next = u->parent[a];
+        u->parent[a] = root;
+        a = next;
+    }
+
+    return root;
+}
+
+/**
+ * adds the site c to the cluster with label a, where c is bonded to a site of that cluster
+ * returns the canonical label of the cluster
+ */
+int labels_add(labels *u, int a, coord c)
+{
+    a = labels_find(u, a);
+    ++u->size[a];
+    u->rows[a] = span_join(u->rows[a], span_point(c.i), c.i, u->n);
+    u->cols[a] = span_join(u->cols[a], span_point(c.j), c.j, u->n);
+    return a;
+}
+
+/**
+ * specifies that the clusters with labels a and b are the same, where the site c belongs
+ * to a and is bonded to a site belonging to b
+ * returns the canonical label of the merged cluster
+ */
+int labels_union(labels *u, int a, int b, coord c)
+{
+    a = labels_find(u, a);
+    b = labels_find(u, b);
+
+    if (a == b) return a;
+
+    //link smaller cluster into larger one - swap if needed
+    if (u->size[a] < u->size[b])
+    {
+        int t = a;
+        a = b;
+        b = t;
+    }
+
+    u->parent[b] = a;
+    u->size[a] += u->size[b];
+    u->rows[a] = span_join(u->rows[a], u->rows[b], c.i, u->n);
+    u->cols[a] = span_join(u->cols[a], u->cols[b], c.j, u->n);
+    return a;
+}
+
+/**
+ * hands out a new label for the whole cluster with canonical label a in another set of labels
+ */
+int labels_copy(labels *u, labels *from, int a)
+{
+    if (u->count == u->max)
+    {
+        labels_grow(u, 2 * u->max);
+    }
+
+    int b = u->count++;
+    u->parent[b] = b;
+    u->size[b] = from->size[a];
+    u->rows[b] = from->rows[a];
+    u->cols[b] = from->cols[a];
+    return b;
+}
@@ -0,0 +1,30 @@
+#ifndef __UNIONFIND_H
+#define __UNIONFIND_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include "util.h"
+#include "lattice.h"
+
+//cluster labels handed out during a raster scan, grouped into equivalence classes
+//with union by size and path compression - label 0 is reserved for `no cluster'
+typedef struct
+{
+    int *parent; //parent label, a label is canonical if it is its own parent
+    int64_t *size; //number of sites, only kept up to date for canonical labels
+    span *rows; //rows reached, only kept up to date for canonical labels
+    span *cols; //cols reached, only kept up to date for canonical labels
+    int count; //number of labels handed out so far, including 0
+    int max; //number of labels there is space for
+    int n; //dimensions of the lattice the labels belong to
+} labels;
+
+void labels_init(labels *u, int n, int max);
+void labels_free(labels *u);
+int labels_new(labels *u, coord c);
+int labels_find(labels *u, int a);
+int labels_add(labels *u, int a, coord c);
+int labels_union(labels *u, int a, int b, coord c);
+int labels_copy(labels *u, labels *from, int a);
+
+#endif
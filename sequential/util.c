@@ -7,3 +7,67 @@ int mod_p(int i, int n)
 {
     return (i % n + n) % n;
 }
+
+/**
+ * the span covering the single row/col x
+ */
+span span_point(int x)
+{
+    span s = {x, 1};
+    return s;
+}
+
+/**
+ * how far a span reaches below and above a pivot, where the span either
+ * contains the pivot or ends right next to it
+ */
+void span_reach(span s, int pivot, int n, int *below, int *above)
+{
+    int d = WRAP(pivot - s.start, n);
+    if (d < s.len)
+    {
+        //pivot inside span
+        *below = d;
+        *above = s.len - 1 - d;
+    }
+    else if (d == s.len)
+    {
+        //pivot just past the end
+        *below = s.len;
+        *above = 0;
+    }
+    else
+    {
+        //pivot just before the start
+        *below = 0;
+        *above = s.len;
+    }
+}
+
+/**
+ * joins the rows/cols covered by two connected groups of sites which are linked
+ * through the row/col `pivot` - each span must contain or be next to the pivot,
+ * in which case the result is exact, as the union of the two is again a run
+ */
+span span_join(span a, span b, int pivot, int n)
+{
+    if (a.len >= n || b.len >= n)
+    {
+        span full = {0, n};
+        return full;
+    }
+
+    int a_below, a_above, b_below, b_above;
+    span_reach(a, pivot, n, &a_below, &a_above);
+    span_reach(b, pivot, n, &b_below, &b_above);
+
+    int below = MAX(a_below, b_below);
+    int above = MAX(a_above, b_above);
+
+    span s = {WRAP(pivot - below, n), MIN(below + above + 1, n)};
+    if (s.len == n)
+    {
+        s.start = 0;
+    }
+    return s;
+}
@@ -1,9 +1,25 @@
 #ifndef __UTIL_H
 #define __UTIL_H
 
+#include <stdbool.h>
+
 #define MAX(x, y) (((x) > (y)) ? (x) : (y))
 #define MIN(x, y) (((x) < (y)) ? (x) : (y))
 
+//x wrapped into 0, ..., n - 1, for x at most n out either way - unlike mod_p, without a division,
+//and with just a mask when n is a power of two
+#define IS_POW2(n) (((n) & ((n) - 1)) == 0)
+#define WRAP(x, n) (IS_POW2(n) ? (x) & ((n) - 1) : (x) < 0 ? (x) + (n) : (x) >= (n) ? (x) - (n) : (x))
+
+//a run of rows (or cols) start, start + 1, ..., start + len - 1, wrapping around mod n
+typedef struct
+{
+    int start, len;
+} span;
+
 int mod_p(int i, int n);
 
+span span_point(int x);
+span span_join(span a, span b, int pivot, int n);
+
 #endif